@@ -7,6 +7,7 @@
 #include <chrono>
 #include <ctime>
 #include <fstream>
+#include <mutex>
 #include <string>
 
 Logger::Logger() : file_(LOGFILE) {}
@@ -14,6 +15,8 @@ Logger::Logger() : file_(LOGFILE) {}
 void Logger::log(const std::string& message) {
   auto time = std::chrono::system_clock::now();
   auto timestamp = std::chrono::system_clock::to_time_t(time);
+  // The render thread logs too.
+  std::lock_guard<std::mutex> lock {mutex_};
   file_ << std::ctime(&timestamp) << " " << message << "\n";
   file_.flush();
 }
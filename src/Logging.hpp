@@ -3,6 +3,7 @@
 // Logging functionality
 
 #include <fstream>
+#include <mutex>
 #include <string>
 
 #ifdef LOG_ON
@@ -25,5 +26,6 @@ class Logger {
   Logger(const Logger&&) = delete;
   void operator=(const Logger&&) = delete;
 
+  std::mutex mutex_;
   std::ofstream file_;
 };
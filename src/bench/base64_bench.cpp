@@ -0,0 +1,83 @@
+// Copyright 2022 Daniel Liu
+
+// Base64 microbenchmark. Checks dcurses::base64Encode against a reference
+// encoder, then reports the time to encode a buffer of random bytes with each.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "dcurses/Base64.hpp"
+
+namespace {
+
+/*
+ * Straightforward reference encoder, one character at a time.
+ */
+std::string referenceEncode(const std::string &input) {
+  static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string output;
+  for (std::size_t i = 0; i < size(input); i += 3) {
+    unsigned int group = static_cast<unsigned int>(static_cast<unsigned char>(input[i])) << 16;
+    if (i + 1 < size(input)) group |= static_cast<unsigned int>(static_cast<unsigned char>(input[i + 1])) << 8;
+    if (i + 2 < size(input)) group |= static_cast<unsigned char>(input[i + 2]);
+    output += chars[(group >> 18) & 0x3f];
+    output += chars[(group >> 12) & 0x3f];
+    output += i + 1 < size(input) ? chars[(group >> 6) & 0x3f] : '=';
+    output += i + 2 < size(input) ? chars[group & 0x3f] : '=';
+  }
+  return output;
+}
+
+/*
+ * Returns the fastest of `repeats` runs of `encode`, in milliseconds.
+ */
+template <typename F>
+double bestOf(unsigned int repeats, F encode) {
+  double best = 1e30;
+  for (unsigned int r = 0; r < repeats; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    encode();
+    best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 10;
+  std::mt19937 random {42};
+  std::string data(megabytes << 20, '\0');
+  for (auto &byte : data) {
+    byte = static_cast<char>(random());
+  }
+
+  // Every length up to a few vector blocks, at every alignment.
+  for (std::size_t length = 0; length < 200; ++length) {
+    for (std::size_t offset = 0; offset < 4; ++offset) {
+      std::string input = data.substr(offset, length);
+      if (dcurses::base64Encode(input) != referenceEncode(input)) {
+        std::cerr << "mismatch at length " << length << ", offset " << offset << "\n";
+        return 1;
+      }
+    }
+  }
+  if (dcurses::base64Encode(data) != referenceEncode(data)) {
+    std::cerr << "mismatch on " << megabytes << " MB\n";
+    return 1;
+  }
+
+  std::string output(dcurses::base64EncodedSize(size(data)), '\0');
+  double reference = bestOf(3, [&] { referenceEncode(data); });
+  double allocating = bestOf(10, [&] { dcurses::base64Encode(data); });
+  double buffered = bestOf(10, [&] { dcurses::base64Encode(data, output.data()); });
+  std::cout << megabytes << " MB\n";
+  std::cout << "  reference:      " << reference << " ms\n";
+  std::cout << "  base64Encode:   " << allocating << " ms\n";
+  std::cout << "  into a buffer:  " << buffered << " ms ("
+            << static_cast<double>(size(data)) / (1 << 20) / buffered * 1000 << " MB/s)\n";
+}
@@ -0,0 +1,146 @@
+// Copyright 2022 Daniel Liu
+
+// Keystroke replay benchmark. Replays a keystroke script against each file on
+// a headless terminal, and reports per-key latency, bytes written per frame,
+// and heap allocations per key. Then resizes the terminal back and forth, and
+// reports the latency and size of the first frame after each resize.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dcurses/FrameStats.hpp"
+#include "dcurses/Terminal.hpp"
+#include "dvim/KeyScript.hpp"
+#include "dvim/dvim.hpp"
+
+// Number of times to resize the terminal after the script is replayed.
+#define RESIZES 10
+
+namespace {
+
+/*
+ * Returns the value at the specified percentile of the sorted samples.
+ */
+template <typename T>
+T percentile(const std::vector<T> &sorted, double p) {
+  if (sorted.empty()) {
+    return T{};
+  }
+  auto index = static_cast<std::size_t>(p / 100.0 * static_cast<double>(size(sorted) - 1) + 0.5);
+  return sorted[index];
+}
+
+template <typename T>
+void report(const std::string &name, std::vector<T> samples) {
+  std::sort(begin(samples), end(samples));
+  double total = 0;
+  for (auto sample : samples) {
+    total += static_cast<double>(sample);
+  }
+  double mean = samples.empty() ? 0 : total / static_cast<double>(size(samples));
+  std::cout << "  " << name << ": mean=" << mean
+            << " p50=" << percentile(samples, 50)
+            << " p90=" << percentile(samples, 90)
+            << " p99=" << percentile(samples, 99)
+            << " max=" << (samples.empty() ? T{} : samples.back()) << "\n";
+}
+
+void usage() {
+  std::cerr << "usage: dvim_bench [-W width] [-H height] [-n repeats] script.keys file...\n";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned int width = 200;
+  unsigned int height = 60;
+  unsigned int repeats = 1;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if ((arg == "-W" || arg == "-H" || arg == "-n") && i + 1 < argc) {
+      auto value = static_cast<unsigned int>(std::stoul(argv[++i]));
+      if (arg == "-W") width = value;
+      if (arg == "-H") height = value;
+      if (arg == "-n") repeats = value;
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (size(args) < 2) {
+    usage();
+    return 1;
+  }
+
+  auto script = dvim::loadKeyScript(args[0]);
+  if (!script) {
+    std::cerr << "cannot read keystroke script " << args[0] << "\n";
+    return 1;
+  }
+  const std::string &keys = *script;
+  for (std::size_t f = 1; f < size(args); ++f) {
+    std::filesystem::path path = args[f];
+    std::vector<double> latencies;
+    std::vector<std::size_t> bytes;
+    std::vector<std::size_t> allocs;
+    std::vector<double> resizeLatencies;
+    std::vector<std::size_t> resizeBytes;
+
+    for (unsigned int r = 0; r < repeats; ++r) {
+      dcurses::HeadlessTerminal terminal {width, height};
+      dvim::dvimController controller {terminal};
+
+      auto start = std::chrono::steady_clock::now();
+      std::size_t startAllocs = dcurses::allocationCount();
+      controller.switchToEditor(path);
+      controller.refresh();
+      auto elapsed = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+      if (r == 0) {
+        std::cout << path.string() << " (" << size(keys) << " keys, "
+                  << width << "x" << height << ")\n";
+        std::cout << "  first frame: us=" << elapsed
+                  << " bytes=" << terminal.bytesWritten()
+                  << " allocations=" << dcurses::allocationCount() - startAllocs << "\n";
+      }
+
+      for (char key : keys) {
+        terminal.clearOutput();
+        start = std::chrono::steady_clock::now();
+        startAllocs = dcurses::allocationCount();
+        if (!controller.handleInput(key)) {
+          break;
+        }
+        controller.refresh();
+        latencies.push_back(std::chrono::duration<double, std::micro>(
+          std::chrono::steady_clock::now() - start).count());
+        allocs.push_back(dcurses::allocationCount() - startAllocs);
+        bytes.push_back(terminal.bytesWritten());
+      }
+
+      for (unsigned int i = 0; i < RESIZES; ++i) {
+        if (i % 2 == 0) {
+          terminal.resize(width * 3 / 4, height * 3 / 4);
+        } else {
+          terminal.resize(width, height);
+        }
+        terminal.clearOutput();
+        start = std::chrono::steady_clock::now();
+        controller.refresh();
+        resizeLatencies.push_back(std::chrono::duration<double, std::micro>(
+          std::chrono::steady_clock::now() - start).count());
+        resizeBytes.push_back(terminal.bytesWritten());
+      }
+    }
+
+    report("latency us/key", latencies);
+    report("bytes/frame", bytes);
+    report("allocations/key", allocs);
+    report("latency us/resize", resizeLatencies);
+    report("bytes/resize", resizeBytes);
+  }
+}
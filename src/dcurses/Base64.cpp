@@ -4,41 +4,161 @@
 
 #include "Base64.hpp"
 
-#include <fstream>
-#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#endif
 
 namespace dcurses {
 
-std::string base64Encode(const std::string &input) {
-  static const std::string base64Chars = 
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-    "abcdefghijklmnopqrstuvwxyz"
-    "0123456789+/";
-
-  std::string output;
-  auto charAt = [&](unsigned int i) -> unsigned char {
-    if (i >= size(input)) {
-      return 0;
-    }
-    return static_cast<unsigned char>(input[i]);
-  };
-  for (unsigned int i = 0; i < size(input); i += 3) {
-    int32_t group = (charAt(i) << 16) | (charAt(i + 1) << 8) | charAt(i + 2);
-    output += base64Chars[(group >> 18) & 0x3F];
-    output += base64Chars[(group >> 12) & 0x3F];
-    if (i + 1 >= size(input)) {
-      output += "=";
-    } else {
-      output += base64Chars[(group >> 6) & 0x3F];
-    }
-    if (i + 2 >= size(input)) {
-      output += "=";
-    } else {
-      output += base64Chars[group & 0x3F];
-    }
+namespace {
+
+constexpr char BASE64_CHARS[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+  "abcdefghijklmnopqrstuvwxyz"
+  "0123456789+/";
+
+/*
+ * Encodes the remaining input one 3-byte group at a time, padding the last group.
+ */
+void encodeScalar(const unsigned char *input, std::size_t length, char *output) {
+  std::size_t i = 0;
+  for (; i + 3 <= length; i += 3) {
+    uint32_t group = (uint32_t{input[i]} << 16) | (uint32_t{input[i + 1]} << 8) | input[i + 2];
+    *output++ = BASE64_CHARS[(group >> 18) & 0x3f];
+    *output++ = BASE64_CHARS[(group >> 12) & 0x3f];
+    *output++ = BASE64_CHARS[(group >> 6) & 0x3f];
+    *output++ = BASE64_CHARS[group & 0x3f];
   }
-  return output;
+  if (i < length) {
+    uint32_t group = uint32_t{input[i]} << 16;
+    if (i + 1 < length) group |= uint32_t{input[i + 1]} << 8;
+    *output++ = BASE64_CHARS[(group >> 18) & 0x3f];
+    *output++ = BASE64_CHARS[(group >> 12) & 0x3f];
+    *output++ = i + 1 < length ? BASE64_CHARS[(group >> 6) & 0x3f] : '=';
+    *output++ = '=';
+  }
+}
+
+#ifdef BASE64_X86
+
+// The vector encoders follow Wojciech Muła's method: shuffle each 3-byte group into a 32-bit
+// lane, split it into four 6-bit indices with two multiplies, then map the indices to ASCII
+// by adding an offset looked up from the index's range.
+
+__attribute__((target("ssse3")))
+__m128i encodeBlock(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  __m128i high = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+  __m128i low = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+  __m128i indices = _mm_or_si128(high, low);
+
+  // 0-25 map to offset 13 ('A'), 26-51 to 0 ('a' - 26), and 52-63 to 1-12 (digits, '+', '/').
+  __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+  __m128i offsets = _mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+__attribute__((target("avx2")))
+__m256i encodeBlock(__m256i in) {
+  in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  __m256i high = _mm256_mulhi_epu16(
+    _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+  __m256i low = _mm256_mullo_epi16(
+    _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+  __m256i indices = _mm256_or_si256(high, low);
+
+  __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  range = _mm256_or_si256(range,
+    _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+  __m256i offsets = _mm256_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+}
+
+/*
+ * Encodes 12 bytes into 16 characters at a time. Each block loads 16 bytes, so the loop stops
+ * while at least 4 bytes remain, and the rest is left to the scalar encoder.
+ */
+__attribute__((target("ssse3")))
+void encodeSsse3(const unsigned char *input, std::size_t length, char *output) {
+  std::size_t i = 0;
+  for (; i + 16 <= length; i += 12, output += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output), encodeBlock(in));
+  }
+  encodeScalar(input + i, length - i, output);
 }
 
+/*
+ * Loads 24 bytes as two 12-byte lanes. Reads 28 bytes.
+ */
+__attribute__((target("avx2")))
+__m256i loadLanes(const unsigned char *input) {
+  __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+  __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + 12));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
 }
+
+/*
+ * Encodes 48 bytes into 64 characters at a time, as two blocks of 24 bytes. Then finishes with
+ * single blocks and the SSSE3 and scalar encoders.
+ */
+__attribute__((target("avx2")))
+void encodeAvx2(const unsigned char *input, std::size_t length, char *output) {
+  std::size_t i = 0;
+  for (; i + 52 <= length; i += 48, output += 64) {
+    __m256i first = encodeBlock(loadLanes(input + i));
+    __m256i second = encodeBlock(loadLanes(input + i + 24));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output), first);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + 32), second);
+  }
+  for (; i + 28 <= length; i += 24, output += 32) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output), encodeBlock(loadLanes(input + i)));
+  }
+  encodeSsse3(input + i, length - i, output);
+}
+
+#endif
+
+using Encoder = void (*)(const unsigned char *, std::size_t, char *);
+
+/*
+ * Picks the fastest encoder the CPU supports.
+ */
+Encoder selectEncoder() {
+#ifdef BASE64_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return encodeAvx2;
+  if (__builtin_cpu_supports("ssse3")) return encodeSsse3;
+#endif
+  return encodeScalar;
+}
+
+}  // namespace
+
+void base64Encode(std::string_view input, char *output) {
+  static const Encoder encoder = selectEncoder();
+  encoder(reinterpret_cast<const unsigned char *>(input.data()), size(input), output);
+}
+
+std::string base64Encode(std::string_view input) {
+  std::string output(base64EncodedSize(size(input)), '\0');
+  base64Encode(input, output.data());
+  return output;
+}
+
+}  // namespace dcurses
@@ -5,16 +5,34 @@
 #ifndef DCURSES_BASE64_HPP_
 #define DCURSES_BASE64_HPP_
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 
 namespace dcurses {
 
+/*
+ * Returns the length of the base64 representation of `length` bytes, including padding.
+ */
+constexpr std::size_t base64EncodedSize(std::size_t length) {
+  return (length + 2) / 3 * 4;
+}
+
+/*
+ * Encodes the provided bytes into base64 representation, writing exactly
+ * base64EncodedSize(size(input)) bytes to `output`. Uses AVX2 or SSSE3 when the CPU supports
+ * them.
+ * @param input The bytes to encode.
+ * @param output The buffer to write the base64 representation to.
+ */
+void base64Encode(std::string_view input, char *output);
+
 /*
  * Encodes the provided string into base64 representation.
  * @param input The string to encode.
  * @return The base64 representation of the input.
  */
-std::string base64Encode(const std::string &input);
+std::string base64Encode(std::string_view input);
 
 }  // namespace dcurses
 
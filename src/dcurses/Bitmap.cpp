@@ -0,0 +1,71 @@
+// Copyright 2022 Daniel Liu
+
+// Bitmap.cpp
+
+#include "Bitmap.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dcurses {
+
+void fittedSize(unsigned int width, unsigned int height, unsigned int maxWidth, unsigned int maxHeight,
+                unsigned int &fittedWidth, unsigned int &fittedHeight) {
+  fittedWidth = width;
+  fittedHeight = height;
+  if (width <= maxWidth && height <= maxHeight) return;
+
+  // Scale by whichever side is further over its limit.
+  fittedWidth = std::max(maxWidth, 1u);
+  fittedHeight = std::max(maxHeight, 1u);
+  if (static_cast<uint64_t>(width) * fittedHeight > static_cast<uint64_t>(height) * fittedWidth) {
+    fittedHeight = static_cast<unsigned int>(std::max<uint64_t>(static_cast<uint64_t>(height) * fittedWidth / width, 1));
+  } else {
+    fittedWidth = static_cast<unsigned int>(std::max<uint64_t>(static_cast<uint64_t>(width) * fittedHeight / height, 1));
+  }
+}
+
+Bitmap fitWithin(const Bitmap &source, unsigned int maxWidth, unsigned int maxHeight) {
+  if (source.width <= maxWidth && source.height <= maxHeight) return source;
+  unsigned int width;
+  unsigned int height;
+  fittedSize(source.width, source.height, maxWidth, maxHeight, width, height);
+
+  // Destination column x averages source columns [columnStart[x], columnStart[x + 1]).
+  std::vector<unsigned int> columnStart(width + 1);
+  for (unsigned int x = 0; x <= width; ++x) {
+    columnStart[x] = static_cast<unsigned int>(static_cast<uint64_t>(x) * source.width / width);
+  }
+
+  Bitmap result {width, height, std::vector<uint8_t>(static_cast<std::size_t>(width) * height * 4)};
+  std::vector<uint64_t> sums(static_cast<std::size_t>(width) * 4);
+  for (unsigned int y = 0; y < height; ++y) {
+    unsigned int top = static_cast<unsigned int>(static_cast<uint64_t>(y) * source.height / height);
+    unsigned int bottom = static_cast<unsigned int>(static_cast<uint64_t>(y + 1) * source.height / height);
+    std::fill(begin(sums), end(sums), 0);
+    for (unsigned int row = top; row < bottom; ++row) {
+      const uint8_t *pixel = source.pixels.data() + static_cast<std::size_t>(row) * source.width * 4;
+      for (unsigned int x = 0; x < width; ++x) {
+        uint64_t *sum = sums.data() + static_cast<std::size_t>(x) * 4;
+        for (unsigned int col = columnStart[x]; col < columnStart[x + 1]; ++col, pixel += 4) {
+          sum[0] += pixel[0];
+          sum[1] += pixel[1];
+          sum[2] += pixel[2];
+          sum[3] += pixel[3];
+        }
+      }
+    }
+    uint8_t *out = result.pixels.data() + static_cast<std::size_t>(y) * width * 4;
+    for (unsigned int x = 0; x < width; ++x) {
+      uint64_t area = static_cast<uint64_t>(bottom - top) * (columnStart[x + 1] - columnStart[x]);
+      for (unsigned int channel = 0; channel < 4; ++channel) {
+        out[x * 4 + channel] = static_cast<uint8_t>((sums[x * 4 + channel] + area / 2) / area);
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace dcurses
@@ -0,0 +1,46 @@
+// Copyright 2022 Daniel Liu
+
+// Bitmap.hpp
+// Decoded images, and scaling them down.
+
+#ifndef DCURSES_BITMAP_HPP_
+#define DCURSES_BITMAP_HPP_
+
+#include <cstdint>
+#include <vector>
+
+// Largest image, in pixels, that the image decoders accept.
+#define MAX_IMAGE_PIXELS (1u << 26)
+
+namespace dcurses {
+
+/*
+ * A decoded image: `width` by `height` pixels, stored row by row as 8-bit RGBA.
+ */
+struct Bitmap {
+  unsigned int width = 0;
+  unsigned int height = 0;
+  std::vector<uint8_t> pixels;
+};
+
+/*
+ * Computes the size of an image scaled down to fit within the specified size, keeping its
+ * aspect ratio. An image that already fits keeps its size.
+ */
+void fittedSize(unsigned int width, unsigned int height, unsigned int maxWidth, unsigned int maxHeight,
+                unsigned int &fittedWidth, unsigned int &fittedHeight);
+
+/*
+ * Scales a bitmap down to fit within the specified size, keeping its aspect ratio, by averaging
+ * the source pixels that make up each destination pixel. A bitmap that already fits is
+ * returned unchanged.
+ * @param source The bitmap to scale.
+ * @param maxWidth The maximum width of the result, in pixels.
+ * @param maxHeight The maximum height of the result, in pixels.
+ * @return The scaled bitmap.
+ */
+Bitmap fitWithin(const Bitmap &source, unsigned int maxWidth, unsigned int maxHeight);
+
+}  // namespace dcurses
+
+#endif
@@ -0,0 +1,309 @@
+// Copyright 2022 Daniel Liu
+
+// CellGrid.cpp
+
+#include "CellGrid.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "CharWidth.hpp"
+#include "TextCells.hpp"
+
+namespace dcurses {
+
+namespace {
+
+/*
+ * An append-only array whose elements never move once added, so that one thread can read
+ * elements while another appends. Readers must learn about an index through some other
+ * synchronization (such as the hand-off of a frame to the render thread), which also makes the
+ * element visible to them.
+ */
+template <typename T, unsigned int CHUNK_BITS, std::size_t CHUNKS>
+class StableArray {
+ public:
+  static constexpr std::size_t CAPACITY = CHUNKS << CHUNK_BITS;
+
+  std::size_t size() const { return size_; }
+
+  void push_back(const T &value) {
+    auto &chunk = chunks_[size_ >> CHUNK_BITS];
+    if (!chunk) chunk = std::make_unique<T[]>(std::size_t {1} << CHUNK_BITS);
+    chunk[size_ & MASK] = value;
+    ++size_;
+  }
+
+  const T &operator[](std::size_t index) const { return chunks_[index >> CHUNK_BITS][index & MASK]; }
+
+ private:
+  static constexpr std::size_t MASK = (std::size_t {1} << CHUNK_BITS) - 1;
+
+  std::unique_ptr<T[]> chunks_[CHUNKS];
+  std::size_t size_ = 0;
+};
+
+struct InternTable {
+  static constexpr uint32_t FULL = UINT32_MAX;
+
+  StableArray<std::string, 10, 1024> values;
+  // Keys view the strings in `values`, which never move, so looking up a grapheme that is already
+  // interned makes no copy of it.
+  std::unordered_map<std::string_view, uint32_t> ids;
+
+  uint32_t intern(std::string_view value) {
+    auto it = ids.find(value);
+    if (it != ids.end()) {
+      return it->second;
+    }
+    if (values.size() == values.CAPACITY) {
+      return FULL;
+    }
+    auto id = static_cast<uint32_t>(values.size());
+    values.push_back(std::string{value});
+    ids.emplace(values[id], id);
+    return id;
+  }
+};
+
+struct StyleTable {
+  StyleTable() { values.push_back(Style{}); }
+
+  StableArray<Style, 8, 256> values;
+  std::unordered_map<uint64_t, uint16_t> ids {{Style{}.key(), 0}};
+};
+
+StyleTable &styleTable() {
+  static StyleTable table;
+  return table;
+}
+
+InternTable &graphemeTable() {
+  static InternTable table;
+  return table;
+}
+
+/*
+ * Decodes `text` if it is exactly one UTF-8 encoded code point. Returns false otherwise.
+ */
+bool decodeCodePoint(std::string_view text, uint32_t &codePoint) {
+  if (text.empty()) return false;
+  std::size_t length;
+  codePoint = decodeUtf8(text, length);
+  // A malformed sequence decodes as U+FFFD one byte long; keep its bytes as a grapheme instead.
+  if (length != size(text) || (length == 1 && codePoint >= 0x80)) return false;
+  return codePoint < CellGrid::GRAPHEME_BIT;
+}
+
+void appendCodePoint(std::string &out, uint32_t codePoint) {
+  if (codePoint < 0x80) {
+    out += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    out += static_cast<char>(0xc0 | (codePoint >> 6));
+    out += static_cast<char>(0x80 | (codePoint & 0x3f));
+  } else if (codePoint < 0x10000) {
+    out += static_cast<char>(0xe0 | (codePoint >> 12));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (codePoint & 0x3f));
+  } else {
+    out += static_cast<char>(0xf0 | (codePoint >> 18));
+    out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (codePoint & 0x3f));
+  }
+}
+
+}  // namespace
+
+CellGrid::CellGrid(unsigned int width, unsigned int height) :
+  width_ {width}, height_ {height},
+  glyphs_(static_cast<std::size_t>(width) * height, ' '),
+  attributes_(static_cast<std::size_t>(width) * height, 0) {
+}
+
+void CellGrid::resize(unsigned int width, unsigned int height) {
+  if (width == width_ && height == height_) return;
+  width_ = width;
+  height_ = height;
+  glyphs_.assign(static_cast<std::size_t>(width) * height, ' ');
+  attributes_.assign(static_cast<std::size_t>(width) * height, 0);
+}
+
+void CellGrid::fill(uint32_t glyph, uint16_t attribute) {
+  std::fill(begin(glyphs_), end(glyphs_), glyph);
+  std::fill(begin(attributes_), end(attributes_), attribute);
+}
+
+void CellGrid::set(unsigned int row, unsigned int col, std::string_view text, uint16_t attribute) {
+  uint32_t glyph;
+  if (!decodeCodePoint(text, glyph)) {
+    uint32_t id = graphemeTable().intern(text);
+    // Out of grapheme ids; show the replacement character instead.
+    glyph = id == InternTable::FULL ? 0xfffd : GRAPHEME_BIT | id;
+  }
+  auto i = index(row, col);
+  glyphs_[i] = glyph;
+  attributes_[i] = attribute;
+}
+
+std::size_t CellGrid::nextDifference(const CellGrid &other, std::size_t from, std::size_t to) const {
+  const uint32_t *glyphs = glyphs_.data();
+  const uint32_t *otherGlyphs = other.glyphs_.data();
+  const uint16_t *attributes = attributes_.data();
+  const uint16_t *otherAttributes = other.attributes_.data();
+  std::size_t i = from;
+#ifdef __SSE2__
+  // Compare 8 cells at a time: two vectors of glyphs and one vector of attributes.
+  for (; i + 8 <= to; i += 8) {
+    __m128i g0 = _mm_cmpeq_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(glyphs + i)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(otherGlyphs + i)));
+    __m128i g1 = _mm_cmpeq_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(glyphs + i + 4)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(otherGlyphs + i + 4)));
+    __m128i a = _mm_cmpeq_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(attributes + i)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(otherAttributes + i)));
+    if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(g0, g1), a)) != 0xffff) {
+      break;
+    }
+  }
+#else
+  for (; i + 8 <= to; i += 8) {
+    if (std::memcmp(glyphs + i, otherGlyphs + i, 8 * sizeof(uint32_t)) != 0 ||
+        std::memcmp(attributes + i, otherAttributes + i, 8 * sizeof(uint16_t)) != 0) {
+      break;
+    }
+  }
+#endif
+  for (; i < to; ++i) {
+    if (glyphs[i] != otherGlyphs[i] || attributes[i] != otherAttributes[i]) {
+      return i;
+    }
+  }
+  return to;
+}
+
+std::size_t CellGrid::countDifferences(const CellGrid &other, std::size_t from, std::size_t to) const {
+  std::size_t count = 0;
+  for (std::size_t i = nextDifference(other, from, to); i < to; i = nextDifference(other, i + 1, to)) {
+    ++count;
+  }
+  return count;
+}
+
+uint64_t CellGrid::hashRow(unsigned int row, unsigned int begin, unsigned int end) const {
+  // FNV-1a over the packed cells.
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (std::size_t i = index(row, begin); i < index(row, end); ++i) {
+    hash = (hash ^ glyphs_[i]) * 0x100000001b3ull;
+    hash = (hash ^ attributes_[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+void CellGrid::scroll(unsigned int top, unsigned int bottom, int lines) {
+  auto rows = static_cast<int>(bottom - top + 1);
+  if (lines >= rows || -lines >= rows) {
+    std::fill(glyphs_.begin() + static_cast<std::ptrdiff_t>(index(top, 0)),
+      glyphs_.begin() + static_cast<std::ptrdiff_t>(index(bottom + 1, 0)), ' ');
+    std::fill(attributes_.begin() + static_cast<std::ptrdiff_t>(index(top, 0)),
+      attributes_.begin() + static_cast<std::ptrdiff_t>(index(bottom + 1, 0)), 0);
+    return;
+  }
+  std::size_t shift = static_cast<std::size_t>(lines < 0 ? -lines : lines) * width_;
+  std::size_t first = index(top, 0);
+  std::size_t last = index(bottom + 1, 0);
+  std::size_t blank;
+  if (lines > 0) {
+    std::memmove(&glyphs_[first], &glyphs_[first + shift], (last - first - shift) * sizeof(uint32_t));
+    std::memmove(&attributes_[first], &attributes_[first + shift], (last - first - shift) * sizeof(uint16_t));
+    blank = last - shift;
+  } else {
+    std::memmove(&glyphs_[first + shift], &glyphs_[first], (last - first - shift) * sizeof(uint32_t));
+    std::memmove(&attributes_[first + shift], &attributes_[first], (last - first - shift) * sizeof(uint16_t));
+    blank = first;
+  }
+  std::fill(glyphs_.begin() + static_cast<std::ptrdiff_t>(blank),
+    glyphs_.begin() + static_cast<std::ptrdiff_t>(blank + shift), ' ');
+  std::fill(attributes_.begin() + static_cast<std::ptrdiff_t>(blank),
+    attributes_.begin() + static_cast<std::ptrdiff_t>(blank + shift), 0);
+}
+
+void CellGrid::fillRect(unsigned int top, unsigned int left, unsigned int bottom, unsigned int right,
+    uint32_t glyph, uint16_t attribute) {
+  for (unsigned int r = top; r < bottom; ++r) {
+    std::fill(glyphs_.begin() + static_cast<std::ptrdiff_t>(index(r, left)),
+      glyphs_.begin() + static_cast<std::ptrdiff_t>(index(r, right)), glyph);
+    std::fill(attributes_.begin() + static_cast<std::ptrdiff_t>(index(r, left)),
+      attributes_.begin() + static_cast<std::ptrdiff_t>(index(r, right)), attribute);
+  }
+}
+
+bool CellGrid::rectIs(unsigned int top, unsigned int left, unsigned int bottom, unsigned int right,
+    uint32_t glyph) const {
+  for (unsigned int r = top; r < bottom; ++r) {
+    for (std::size_t i = index(r, left); i < index(r, right); ++i) {
+      if (glyphs_[i] != glyph) return false;
+    }
+  }
+  return true;
+}
+
+void CellGrid::appendText(std::string &out, std::size_t index) const {
+  uint32_t glyph = glyphs_[index];
+  if (glyph == IMAGE_GLYPH) {
+    out += ' ';
+  } else if (glyph == CONTINUATION_GLYPH) {
+    return;
+  } else if (glyph & GRAPHEME_BIT) {
+    out += graphemeTable().values[glyph & ~GRAPHEME_BIT];
+  } else {
+    appendCodePoint(out, glyph);
+  }
+}
+
+unsigned int CellGrid::glyphWidth(uint32_t glyph) {
+  if (glyph < 0x300 || glyph == IMAGE_GLYPH || glyph == INVALID_GLYPH) return 1;
+  if (glyph == CONTINUATION_GLYPH) return 0;
+  if (glyph & GRAPHEME_BIT) {
+    // A grapheme is as wide as its first code point; the rest are zero-width.
+    const std::string &text = graphemeTable().values[glyph & ~GRAPHEME_BIT];
+    std::size_t length;
+    return text.empty() ? 1 : charWidth(decodeUtf8(text, length));
+  }
+  return charWidth(glyph);
+}
+
+uint16_t CellGrid::internStyle(const Style &style) {
+  auto &table = styleTable();
+  auto it = table.ids.find(style.key());
+  if (it != table.ids.end()) {
+    return it->second;
+  }
+  if (table.values.size() == table.values.CAPACITY) {
+    // Out of attribute indices; fall back to the default style.
+    return 0;
+  }
+  auto id = static_cast<uint16_t>(table.values.size());
+  table.values.push_back(style);
+  table.ids.emplace(style.key(), id);
+  return id;
+}
+
+const Style &CellGrid::style(uint16_t index) {
+  return styleTable().values[index];
+}
+
+}  // namespace dcurses
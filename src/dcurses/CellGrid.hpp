@@ -0,0 +1,149 @@
+// Copyright 2022 Daniel Liu
+
+// CellGrid.hpp
+// Packed storage for a rectangle of terminal cells.
+
+#ifndef DCURSES_CELL_GRID_HPP_
+#define DCURSES_CELL_GRID_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Style.hpp"
+
+namespace dcurses {
+
+/*
+ * A rectangle of terminal cells, stored as a flat struct-of-arrays. Each cell is a glyph and an
+ * attribute index. A glyph is either a Unicode code point, or (with GRAPHEME_BIT set) the id of
+ * an interned grapheme for cells that are not a single code point. An attribute index refers to
+ * an interned Style, with 0 meaning the default style.
+ *
+ * The grid is allocated once and cleared in place, so rendering into it does not allocate.
+ *
+ * Styles and graphemes are interned in tables shared by all grids. Interning must happen on one
+ * thread (the one drawing windows), but style() and appendText() may be called on another
+ * thread for any grid handed to it, since table entries never move once added.
+ */
+class CellGrid {
+ public:
+  static constexpr uint32_t GRAPHEME_BIT = 0x80000000u;
+
+  /*
+   * Glyph of a cell whose contents are unknown. Never equal to a rendered cell.
+   */
+  static constexpr uint32_t INVALID_GLYPH = 0xffffffffu;
+
+  /*
+   * Glyph of a cell covered by an inline image. Written to the terminal as a blank.
+   */
+  static constexpr uint32_t IMAGE_GLYPH = 0xfffffffeu;
+
+  /*
+   * Glyph of the cell covered by the right half of a wide character, which is written to the
+   * terminal along with the left half.
+   */
+  static constexpr uint32_t CONTINUATION_GLYPH = 0xfffffffdu;
+
+  /*
+   * Construct a grid of the specified size, filled with blank cells.
+   */
+  CellGrid(unsigned int width, unsigned int height);
+
+  /*
+   * Changes the size of the grid, leaving every cell blank. Does nothing if the size is
+   * unchanged. Only reallocates when the grid grows past its capacity.
+   */
+  void resize(unsigned int width, unsigned int height);
+
+  /*
+   * Sets every cell to the specified glyph and attribute, without reallocating.
+   */
+  void fill(uint32_t glyph = ' ', uint16_t attribute = 0);
+
+  /*
+   * Sets a single cell. `text` is the UTF-8 contents of the cell.
+   */
+  void set(unsigned int row, unsigned int col, std::string_view text, uint16_t attribute);
+
+  /*
+   * Returns the index of the first cell in [from, to) that differs from the same cell of
+   * `other`, or `to` if there is none. Both grids must be the same size.
+   */
+  std::size_t nextDifference(const CellGrid &other, std::size_t from, std::size_t to) const;
+
+  /*
+   * Returns the number of cells in [from, to) that differ from the same cells of `other`.
+   */
+  std::size_t countDifferences(const CellGrid &other, std::size_t from, std::size_t to) const;
+
+  /*
+   * Returns a hash of the cells in [begin, end) of the specified row.
+   */
+  uint64_t hashRow(unsigned int row, unsigned int begin, unsigned int end) const;
+
+  /*
+   * Scrolls rows [top, bottom] up by `lines` (down if negative), the way a terminal scrolls a
+   * scroll region. Rows scrolled in are blank.
+   */
+  void scroll(unsigned int top, unsigned int bottom, int lines);
+
+  /*
+   * Sets every cell in rows [top, bottom) and columns [left, right) to the specified glyph and
+   * attribute.
+   */
+  void fillRect(unsigned int top, unsigned int left, unsigned int bottom, unsigned int right,
+    uint32_t glyph, uint16_t attribute = 0);
+
+  /*
+   * Returns true if every cell in rows [top, bottom) and columns [left, right) has the
+   * specified glyph.
+   */
+  bool rectIs(unsigned int top, unsigned int left, unsigned int bottom, unsigned int right,
+    uint32_t glyph) const;
+
+  /*
+   * Appends the UTF-8 contents of the cell at the specified index to `out`.
+   */
+  void appendText(std::string &out, std::size_t index) const;
+
+  /*
+   * Interns a style and returns its attribute index.
+   */
+  static uint16_t internStyle(const Style &style);
+
+  /*
+   * Returns the style for the specified attribute index.
+   */
+  static const Style &style(uint16_t index);
+
+  /*
+   * Returns the number of columns the terminal gives a glyph: 2 for wide characters, 0 for the
+   * right half of one and for stray zero-width characters, and 1 otherwise.
+   */
+  static unsigned int glyphWidth(uint32_t glyph);
+
+  unsigned int width() const { return width_; }
+  unsigned int height() const { return height_; }
+  std::size_t index(unsigned int row, unsigned int col) const {
+    return static_cast<std::size_t>(row) * width_ + col;
+  }
+
+  uint32_t *glyphs() { return glyphs_.data(); }
+  const uint32_t *glyphs() const { return glyphs_.data(); }
+  uint16_t *attributes() { return attributes_.data(); }
+  const uint16_t *attributes() const { return attributes_.data(); }
+
+ private:
+  unsigned int width_;
+  unsigned int height_;
+  std::vector<uint32_t> glyphs_;
+  std::vector<uint16_t> attributes_;
+};
+
+}  // namespace dcurses
+
+#endif
@@ -0,0 +1,186 @@
+// Copyright 2022 Daniel Liu
+
+// FrameEncoder.cpp
+
+#include "FrameEncoder.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "Base64.hpp"
+
+namespace dcurses {
+
+namespace {
+
+std::size_t digits(unsigned int number) {
+  std::size_t count = 1;
+  while (number >= 10) {
+    number /= 10;
+    ++count;
+  }
+  return count;
+}
+
+}  // namespace
+
+FrameEncoder::FrameEncoder(std::size_t capacity) {
+  buffer_.reserve(capacity);
+}
+
+void FrameEncoder::begin(unsigned int screenWidth) {
+  buffer_.clear();
+  screenWidth_ = screenWidth;
+}
+
+void FrameEncoder::appendBase64(std::string_view data) {
+  std::size_t start = size(buffer_);
+  buffer_.resize(start + base64EncodedSize(size(data)));
+  base64Encode(data, buffer_.data() + start);
+}
+
+void FrameEncoder::appendNumber(unsigned int number) {
+  char digitBuffer[10];
+  std::size_t count = 0;
+  do {
+    digitBuffer[count++] = static_cast<char>('0' + number % 10);
+    number /= 10;
+  } while (number != 0);
+  while (count > 0) {
+    buffer_ += digitBuffer[--count];
+  }
+}
+
+std::size_t FrameEncoder::csiLength(unsigned int parameter) {
+  return 3 + (parameter == 1 ? 0 : digits(parameter));
+}
+
+void FrameEncoder::appendCsi(unsigned int parameter, char final) {
+  buffer_ += "\33[";
+  if (parameter != 1) appendNumber(parameter);
+  buffer_ += final;
+}
+
+std::size_t FrameEncoder::columnMoveLength(unsigned int col) const {
+  if (col == col_) return 0;
+  if (col == 0) return 1;
+  // CHA, absolute column.
+  std::size_t best = csiLength(col + 1);
+  if (col > col_) {
+    best = std::min(best, csiLength(col - col_));
+  } else {
+    unsigned int distance = col_ - col;
+    best = std::min({best, csiLength(distance), static_cast<std::size_t>(distance), 1 + csiLength(col)});
+  }
+  return best;
+}
+
+void FrameEncoder::appendColumnMove(unsigned int col) {
+  if (col == col_) return;
+  if (col == 0) {
+    buffer_ += '\r';
+    return;
+  }
+  std::size_t absolute = csiLength(col + 1);
+  if (col > col_) {
+    if (csiLength(col - col_) <= absolute) {
+      appendCsi(col - col_, 'C');
+    } else {
+      appendCsi(col + 1, 'G');
+    }
+    return;
+  }
+  unsigned int distance = col_ - col;
+  std::size_t backward = csiLength(distance);
+  std::size_t fromStart = 1 + csiLength(col);
+  std::size_t best = std::min({absolute, backward, fromStart, static_cast<std::size_t>(distance)});
+  if (distance == best) {
+    buffer_.append(distance, '\b');
+  } else if (backward == best) {
+    appendCsi(distance, 'D');
+  } else if (fromStart == best) {
+    buffer_ += '\r';
+    appendCsi(col, 'C');
+  } else {
+    appendCsi(col + 1, 'G');
+  }
+}
+
+void FrameEncoder::moveTo(unsigned int row, unsigned int col) {
+  if (cursorKnown_ && row == row_) {
+    appendColumnMove(col);
+    col_ = col;
+    return;
+  }
+
+  // CUP, absolute position: ESC[row;colH, with defaults omitted.
+  std::size_t absolute = 3 + (row == 0 && col == 0 ? 0 : digits(row + 1)) + (col == 0 ? 0 : 1 + digits(col + 1));
+  if (cursorKnown_) {
+    unsigned int distance = row > row_ ? row - row_ : row_ - row;
+    if (csiLength(distance) + columnMoveLength(col) < absolute) {
+      appendCsi(distance, row > row_ ? 'B' : 'A');
+      appendColumnMove(col);
+      row_ = row;
+      col_ = col;
+      return;
+    }
+  }
+
+  buffer_ += "\33[";
+  if (row != 0 || col != 0) appendNumber(row + 1);
+  if (col != 0) {
+    buffer_ += ';';
+    appendNumber(col + 1);
+  }
+  buffer_ += 'H';
+  cursorKnown_ = true;
+  row_ = row;
+  col_ = col;
+}
+
+void FrameEncoder::scroll(unsigned int top, unsigned int bottom, int lines) {
+  // Erased rows take the current background color.
+  setStyle(Style{});
+  // DECSTBM, then SU/SD, then reset the region to the whole screen.
+  buffer_ += "\33[";
+  appendNumber(top + 1);
+  buffer_ += ';';
+  appendNumber(bottom + 1);
+  buffer_ += 'r';
+  appendCsi(static_cast<unsigned int>(lines < 0 ? -lines : lines), lines < 0 ? 'T' : 'S');
+  buffer_ += "\33[r";
+  // Setting the region homes the cursor on most terminals, but not reliably on all of them.
+  cursorKnown_ = false;
+}
+
+void FrameEncoder::setStyle(const Style &style) {
+  if (styleKnown_ && style == style_) return;
+  char parameters[SGR_BUFFER_SIZE];
+  buffer_ += "\33[";
+  if (styleKnown_) {
+    buffer_.append(parameters, encodeSgrTransition(style_, style, parameters));
+  } else {
+    // Nothing is known about the current style, so reset it first.
+    std::size_t length = encodeSgrTransition(Style{}, style, parameters);
+    buffer_ += '0';
+    if (length > 0) buffer_ += ';';
+    buffer_.append(parameters, length);
+  }
+  buffer_ += 'm';
+  styleKnown_ = true;
+  style_ = style;
+}
+
+void FrameEncoder::put(std::string_view text, unsigned int width) {
+  buffer_.append(text);
+  col_ += width;
+  // Writing the last column leaves the cursor in a pending-wrap state that terminals disagree
+  // on, so forget the position.
+  if (width == 0 || col_ >= screenWidth_) {
+    cursorKnown_ = false;
+  }
+}
+
+}  // namespace dcurses
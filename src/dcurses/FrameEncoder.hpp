@@ -0,0 +1,119 @@
+// Copyright 2022 Daniel Liu
+
+// FrameEncoder.hpp
+// Encodes a frame's worth of terminal output into one buffer.
+
+#ifndef DCURSES_FRAME_ENCODER_HPP_
+#define DCURSES_FRAME_ENCODER_HPP_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "Style.hpp"
+
+namespace dcurses {
+
+/*
+ * Collects all output for a frame into one preallocated buffer, so that the frame can be sent
+ * with a single write. The encoder tracks the terminal cursor, so that writes to adjacent cells
+ * need no cursor movement and other moves use the shortest escape sequence available. It also
+ * tracks the terminal's current style, and only sends the SGR parameters that change.
+ */
+class FrameEncoder {
+ public:
+  /*
+   * Construct an encoder with the specified initial buffer capacity, in bytes.
+   */
+  explicit FrameEncoder(std::size_t capacity = 1 << 16);
+
+  /*
+   * Starts a new frame on a screen of the specified width. Clears the buffer, keeping its
+   * capacity. The cursor position carries over from the previous frame.
+   */
+  void begin(unsigned int screenWidth);
+
+  /*
+   * Moves the cursor to the specified 0-indexed position.
+   */
+  void moveTo(unsigned int row, unsigned int col);
+
+  /*
+   * Writes the text of one cell at the cursor. `width` is the number of columns the text
+   * advances the cursor by, or 0 if that is not known, in which case the cursor position is
+   * forgotten.
+   */
+  void put(std::string_view text, unsigned int width);
+
+  /*
+   * Scrolls screen rows [top, bottom] up by `lines` (down if negative), using a scroll region.
+   * The rows scrolled in are blank, in the default style.
+   */
+  void scroll(unsigned int top, unsigned int bottom, int lines);
+
+  /*
+   * Sets the style of the cells written after this call, sending only the attributes that
+   * differ from the current style.
+   */
+  void setStyle(const Style &style);
+
+  /*
+   * Appends raw bytes that neither move the cursor nor change the style.
+   */
+  void append(std::string_view data) { buffer_.append(data); }
+
+  /*
+   * Appends the base64 representation of `data`, encoding it directly into the frame buffer.
+   */
+  void appendBase64(std::string_view data);
+
+  /*
+   * Appends a decimal number.
+   */
+  void appendNumber(unsigned int number);
+
+  /*
+   * Forgets the cursor position, for after output whose effect on the cursor is unknown.
+   */
+  void invalidateCursor() { cursorKnown_ = false; }
+
+  /*
+   * Returns the encoded frame.
+   */
+  std::string_view data() const { return buffer_; }
+
+ private:
+  /*
+   * Returns the number of bytes needed for a CSI sequence with the specified parameter, where a
+   * parameter of 1 is omitted.
+   */
+  static std::size_t csiLength(unsigned int parameter);
+
+  /*
+   * Appends a CSI sequence with the specified parameter and final byte, omitting a parameter
+   * of 1.
+   */
+  void appendCsi(unsigned int parameter, char final);
+
+  /*
+   * Appends the shortest sequence that moves the cursor horizontally within its row.
+   */
+  void appendColumnMove(unsigned int col);
+
+  /*
+   * Returns the length of the sequence appendColumnMove would write.
+   */
+  std::size_t columnMoveLength(unsigned int col) const;
+
+  std::string buffer_;
+  unsigned int screenWidth_ = 0;
+  bool styleKnown_ = false;
+  Style style_;
+  bool cursorKnown_ = false;
+  unsigned int row_ = 0;
+  unsigned int col_ = 0;
+};
+
+}  // namespace dcurses
+
+#endif
@@ -0,0 +1,165 @@
+// Copyright 2022 Daniel Liu
+
+// FrameStats.cpp
+
+#include "FrameStats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> allocations {0};
+
+}  // namespace
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+namespace dcurses {
+
+namespace {
+
+/*
+ * A counter of FrameSample, with the name it is reported and dumped under.
+ */
+struct Counter {
+  const char *name;
+  double (*value)(const FrameSample &sample);
+};
+
+const Counter COUNTERS[] = {
+  {"view_us", [](const FrameSample &s) { return s.viewMicros; }},
+  {"compose_us", [](const FrameSample &s) { return s.composeMicros; }},
+  {"diff_us", [](const FrameSample &s) { return s.diffMicros; }},
+  {"write_us", [](const FrameSample &s) { return s.writeMicros; }},
+  {"cells_changed", [](const FrameSample &s) { return static_cast<double>(s.cellsChanged); }},
+  {"bytes_written", [](const FrameSample &s) { return static_cast<double>(s.bytesWritten); }},
+  {"allocations", [](const FrameSample &s) { return static_cast<double>(s.allocations); }},
+};
+
+/*
+ * Formats a counter's value: times with one decimal place, counts as integers.
+ */
+std::string format(double value) {
+  char buffer[32];
+  if (value == static_cast<double>(static_cast<uint64_t>(value))) {
+    snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(value));
+  } else {
+    snprintf(buffer, sizeof(buffer), "%.1f", value);
+  }
+  return buffer;
+}
+
+}  // namespace
+
+std::size_t allocationCount() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+void FrameStats::record(const FrameSample &sample) {
+  std::lock_guard<std::mutex> lock {mutex_};
+  if (size(samples_) < FRAME_STATS_CAPACITY) {
+    samples_.push_back(sample);
+  } else {
+    samples_[next_] = sample;
+  }
+  next_ = (next_ + 1) % FRAME_STATS_CAPACITY;
+  ++recorded_;
+}
+
+std::vector<FrameSample> FrameStats::samples() const {
+  std::lock_guard<std::mutex> lock {mutex_};
+  if (size(samples_) < FRAME_STATS_CAPACITY) return samples_;
+  std::vector<FrameSample> ordered(begin(samples_) + static_cast<std::ptrdiff_t>(next_), end(samples_));
+  ordered.insert(end(ordered), begin(samples_), begin(samples_) + static_cast<std::ptrdiff_t>(next_));
+  return ordered;
+}
+
+uint64_t FrameStats::framesRecorded() const {
+  std::lock_guard<std::mutex> lock {mutex_};
+  return recorded_;
+}
+
+std::vector<std::string> FrameStats::summary() const {
+  auto frames = samples();
+  std::vector<std::string> lines;
+  std::vector<double> values(size(frames));
+  for (const Counter &counter : COUNTERS) {
+    std::transform(begin(frames), end(frames), begin(values), counter.value);
+    std::sort(begin(values), end(values));
+    auto percentile = [&values](double p) {
+      if (values.empty()) return 0.0;
+      return values[static_cast<std::size_t>(p / 100.0 * static_cast<double>(size(values) - 1) + 0.5)];
+    };
+    char line[128];
+    snprintf(line, sizeof(line), "%-14s p50=%-9s p90=%-9s p99=%-9s max=%s", counter.name,
+             format(percentile(50)).c_str(), format(percentile(90)).c_str(), format(percentile(99)).c_str(),
+             format(percentile(100)).c_str());
+    lines.emplace_back(line);
+  }
+  return lines;
+}
+
+void FrameStats::writeCsv(std::ostream &out) const {
+  for (const Counter &counter : COUNTERS) {
+    out << counter.name << (&counter == &COUNTERS[std::size(COUNTERS) - 1] ? "\n" : ",");
+  }
+  for (const FrameSample &sample : samples()) {
+    for (const Counter &counter : COUNTERS) {
+      out << format(counter.value(sample)) << (&counter == &COUNTERS[std::size(COUNTERS) - 1] ? "\n" : ",");
+    }
+  }
+}
+
+void FrameStats::writeJson(std::ostream &out) const {
+  out << "[";
+  bool first = true;
+  for (const FrameSample &sample : samples()) {
+    out << (first ? "\n  {" : ",\n  {");
+    first = false;
+    for (const Counter &counter : COUNTERS) {
+      out << (&counter == COUNTERS ? "\"" : ", \"") << counter.name << "\": " << format(counter.value(sample));
+    }
+    out << "}";
+  }
+  out << "\n]\n";
+}
+
+bool FrameStats::save(const std::filesystem::path &path) const {
+  std::ofstream file {path};
+  if (!file) return false;
+  if (path.extension() == ".json") {
+    writeJson(file);
+  } else {
+    writeCsv(file);
+  }
+  file.close();
+  return static_cast<bool>(file);
+}
+
+}  // namespace dcurses
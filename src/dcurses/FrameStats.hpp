@@ -0,0 +1,96 @@
+// Copyright 2022 Daniel Liu
+
+// FrameStats.hpp
+// Per-frame render counters.
+
+#ifndef DCURSES_FRAME_STATS_HPP_
+#define DCURSES_FRAME_STATS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Number of frames whose counters are kept. Older frames are overwritten.
+#define FRAME_STATS_CAPACITY 8192
+
+namespace dcurses {
+
+/*
+ * Counters for one frame written to the terminal. Times are in microseconds.
+ */
+struct FrameSample {
+  // Drawing the windows' contents, from WindowManager::beginFrame to refresh.
+  double viewMicros = 0;
+  // Composing the windows into a frame.
+  double composeMicros = 0;
+  // Diffing the frame against the last frame sent, and encoding the changes.
+  double diffMicros = 0;
+  // Writing the encoded frame to the terminal.
+  double writeMicros = 0;
+  uint64_t cellsChanged = 0;
+  uint64_t bytesWritten = 0;
+  // Heap allocations made by the process while the frame was drawn and composed.
+  uint64_t allocations = 0;
+};
+
+/*
+ * Returns the number of heap allocations the process has made so far. They are counted by
+ * the global operator new, which FrameStats.cpp replaces.
+ */
+std::size_t allocationCount();
+
+/*
+ * The counters of the last FRAME_STATS_CAPACITY frames. Frames are recorded by the thread that
+ * writes them to the terminal, and can be read from any thread.
+ */
+class FrameStats {
+ public:
+  /*
+   * Records the counters of a frame.
+   */
+  void record(const FrameSample &sample);
+
+  /*
+   * Returns the recorded frames, oldest first.
+   */
+  std::vector<FrameSample> samples() const;
+
+  /*
+   * Returns the number of frames recorded so far, including frames whose counters have since
+   * been overwritten by newer ones.
+   */
+  uint64_t framesRecorded() const;
+
+  /*
+   * Returns one line per counter, with its median, 90th and 99th percentiles and maximum
+   * over the recorded frames.
+   */
+  std::vector<std::string> summary() const;
+
+  /*
+   * Writes the recorded frames as CSV, with a header row, or as a JSON array of objects.
+   */
+  void writeCsv(std::ostream &out) const;
+  void writeJson(std::ostream &out) const;
+
+  /*
+   * Writes the recorded frames to a file: as JSON if its extension is .json, and as CSV
+   * otherwise.
+   * @return false if the file could not be written.
+   */
+  bool save(const std::filesystem::path &path) const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<FrameSample> samples_;  // A ring buffer, once full.
+  std::size_t next_ = 0;
+  uint64_t recorded_ = 0;
+};
+
+}  // namespace dcurses
+
+#endif
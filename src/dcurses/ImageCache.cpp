@@ -0,0 +1,216 @@
+// Copyright 2022 Daniel Liu
+
+// ImageCache.cpp
+
+#include "ImageCache.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Bitmap.hpp"
+#include "Jpeg.hpp"
+#include "Logging.hpp"
+#include "Png.hpp"
+
+namespace dcurses {
+
+namespace {
+
+ImageFormat detectFormat(std::string_view contents) {
+  if (contents.substr(0, 8) == "\x89PNG\r\n\x1a\n") return ImageFormat::PNG;
+  if (contents.substr(0, 3) == "\xff\xd8\xff") return ImageFormat::JPEG;
+  return ImageFormat::UNKNOWN;
+}
+
+bool readFile(const std::filesystem::path &path, std::string &contents) {
+  std::ifstream file {path, std::ios::binary};
+  if (!file) return false;
+  contents.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+  return true;
+}
+
+/*
+ * Writes a thumbnail to disk. It is written under a temporary name and then renamed, so that a
+ * partly written thumbnail is never read. Failures are ignored, as the thumbnail is only a cache.
+ */
+void writeThumbnail(const std::filesystem::path &path, std::string_view contents) {
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+  if (error) return;
+  auto temporaryPath = path;
+  temporaryPath += "." + std::to_string(getpid()) + ".tmp";
+  std::ofstream file {temporaryPath, std::ios::binary};
+  file.write(contents.data(), static_cast<std::streamsize>(size(contents)));
+  file.close();
+  if (file) {
+    std::filesystem::rename(temporaryPath, path, error);
+  } else {
+    std::filesystem::remove(temporaryPath, error);
+  }
+}
+
+/*
+ * Removes the least recently used thumbnails until the rest fit in THUMBNAIL_CACHE_BYTES.
+ * Thumbnails are touched when they are read, so their modification times order them by use.
+ */
+void pruneThumbnails(const std::filesystem::path &directory) {
+  struct Thumbnail {
+    std::filesystem::file_time_type used;
+    std::uintmax_t size;
+    std::filesystem::path path;
+  };
+  std::vector<Thumbnail> thumbnails;
+  std::uintmax_t total = 0;
+  std::error_code error;
+  for (std::filesystem::directory_iterator entry {directory, error}, last; !error && entry != last;
+       entry.increment(error)) {
+    std::error_code entryError;
+    if (entry->path().extension() != ".png" || !entry->is_regular_file(entryError)) continue;
+    auto used = entry->last_write_time(entryError);
+    auto size = entry->file_size(entryError);
+    if (entryError) continue;
+    thumbnails.push_back({used, size, entry->path()});
+    total += size;
+  }
+  if (total <= THUMBNAIL_CACHE_BYTES) return;
+
+  std::sort(begin(thumbnails), end(thumbnails), [](const Thumbnail &a, const Thumbnail &b) {
+    return a.used < b.used;
+  });
+  for (const Thumbnail &thumbnail : thumbnails) {
+    if (total <= THUMBNAIL_CACHE_BYTES) break;
+    if (std::filesystem::remove(thumbnail.path, error)) total -= thumbnail.size;
+  }
+}
+
+/*
+ * Scales an image file down to a PNG that fits within the bounds. Returns std::nullopt if the
+ * file should be sent as it is, because it already fits or cannot be decoded.
+ */
+std::optional<CachedImage> makeThumbnail(std::string_view contents, ImageFormat format, unsigned int maxWidth,
+                                         unsigned int maxHeight) {
+  std::optional<Bitmap> bitmap;
+  if (format == ImageFormat::PNG) {
+    unsigned int width;
+    unsigned int height;
+    if (!readPngSize(contents, width, height) || (width <= maxWidth && height <= maxHeight)) return std::nullopt;
+    bitmap = decodePng(contents);
+  } else if (format == ImageFormat::JPEG) {
+    // JPEGs are converted even if they fit, as not every terminal can show them.
+    bitmap = decodeJpeg(contents, maxWidth, maxHeight);
+  }
+  if (!bitmap) return std::nullopt;
+
+  Bitmap thumbnail = fitWithin(*bitmap, maxWidth, maxHeight);
+  return CachedImage{encodePng(thumbnail), ImageFormat::PNG, thumbnail.width, thumbnail.height};
+}
+
+/*
+ * Names the thumbnail of a file by a hash (FNV-1a) of everything that the thumbnail depends on.
+ */
+std::string thumbnailName(const std::filesystem::path &path, std::filesystem::file_time_type modified,
+                          std::uintmax_t size, unsigned int maxWidth, unsigned int maxHeight) {
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](std::string_view data) {
+    for (char c : data) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+  };
+  mix(std::filesystem::absolute(path).string());
+  for (auto value : {static_cast<uint64_t>(modified.time_since_epoch().count()), static_cast<uint64_t>(size),
+                     static_cast<uint64_t>(maxWidth), static_cast<uint64_t>(maxHeight)}) {
+    mix(std::string_view{reinterpret_cast<const char *>(&value), sizeof(value)});
+  }
+  char name[24];
+  snprintf(name, sizeof(name), "%016llx.png", static_cast<unsigned long long>(hash));
+  return name;
+}
+
+}  // namespace
+
+ImageCache::ImageCache(std::filesystem::path thumbnailDirectory) :
+  thumbnailDirectory_(std::move(thumbnailDirectory)) {}
+
+std::filesystem::path ImageCache::defaultThumbnailDirectory() {
+  std::filesystem::path cache;
+  if (const char *xdgCacheHome = getenv("XDG_CACHE_HOME"); xdgCacheHome && *xdgCacheHome) {
+    cache = xdgCacheHome;
+  } else if (const char *home = getenv("HOME"); home && *home) {
+    cache = std::filesystem::path{home} / ".cache";
+  } else {
+    return {};
+  }
+  return cache / "dvim" / "thumbnails";
+}
+
+std::shared_ptr<const CachedImage> ImageCache::load(const std::filesystem::path &path, unsigned int maxWidth,
+                                                    unsigned int maxHeight) {
+  std::error_code error;
+  auto modified = std::filesystem::last_write_time(path, error);
+  if (error) return nullptr;
+  auto fileSize = std::filesystem::file_size(path, error);
+  if (error) return nullptr;
+
+  auto it = entries_.find(path.string());
+  if (it != entries_.end() && it->second.modified == modified && it->second.size == fileSize &&
+      it->second.maxWidth == maxWidth && it->second.maxHeight == maxHeight) {
+    it->second.lastUsed = ++clock_;
+    return it->second.image;
+  }
+
+  std::shared_ptr<const CachedImage> image;
+  std::filesystem::path thumbnailPath;
+  if (!thumbnailDirectory_.empty()) {
+    thumbnailPath = thumbnailDirectory_ / thumbnailName(path, modified, fileSize, maxWidth, maxHeight);
+    std::string contents;
+    unsigned int width;
+    unsigned int height;
+    if (readFile(thumbnailPath, contents) && readPngSize(contents, width, height)) {
+      std::filesystem::last_write_time(thumbnailPath, std::filesystem::file_time_type::clock::now(), error);
+      image = std::make_shared<const CachedImage>(CachedImage{std::move(contents), ImageFormat::PNG, width, height});
+    }
+  }
+
+  if (!image) {
+    LOG("Loading image " + path.string());
+    std::string contents;
+    if (!readFile(path, contents)) return nullptr;
+    ImageFormat format = detectFormat(contents);
+    if (auto thumbnail = makeThumbnail(contents, format, maxWidth, maxHeight)) {
+      if (!thumbnailPath.empty()) {
+        writeThumbnail(thumbnailPath, thumbnail->contents);
+        pruneThumbnails(thumbnailDirectory_);
+      }
+      image = std::make_shared<const CachedImage>(std::move(*thumbnail));
+    } else {
+      unsigned int width = 0;
+      unsigned int height = 0;
+      if (format == ImageFormat::PNG) readPngSize(contents, width, height);
+      image = std::make_shared<const CachedImage>(CachedImage{std::move(contents), format, width, height});
+    }
+  }
+
+  if (it == entries_.end() && size(entries_) >= IMAGE_CACHE_SIZE) {
+    entries_.erase(std::min_element(begin(entries_), end(entries_), [](const auto &a, const auto &b) {
+      return a.second.lastUsed < b.second.lastUsed;
+    }));
+  }
+  entries_[path.string()] = Entry{modified, fileSize, maxWidth, maxHeight, ++clock_, image};
+  return image;
+}
+
+}  // namespace dcurses
@@ -0,0 +1,97 @@
+// Copyright 2022 Daniel Liu
+
+// ImageCache.hpp
+// Cache of image files for inline display.
+
+#ifndef DCURSES_IMAGE_CACHE_HPP_
+#define DCURSES_IMAGE_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Maximum number of images kept in an ImageCache.
+#define IMAGE_CACHE_SIZE 16
+
+// Maximum total size of the thumbnails kept on disk. The least recently used are removed first.
+#define THUMBNAIL_CACHE_BYTES (64 * 1024 * 1024)
+
+namespace dcurses {
+
+/*
+ * Image file formats, as recognized from a file's first bytes.
+ */
+enum class ImageFormat {
+  PNG,
+  JPEG,
+  UNKNOWN,
+};
+
+/*
+ * An image ready to be sent to the terminal: a thumbnail that fits the area it is shown in, or
+ * the original file if it already fits or cannot be decoded. The contents are base64 encoded
+ * straight into the frame buffer when the image is sent, so the cache holds only the raw bytes.
+ */
+struct CachedImage {
+  std::string contents;
+  ImageFormat format;
+  // The size of the image in pixels, or 0 if it is not known.
+  unsigned int width;
+  unsigned int height;
+};
+
+/*
+ * Caches images by path, so that an image is read and scaled once rather than on every refresh.
+ * An entry is reloaded when the file's modification time or size changes, or when it is loaded
+ * for a different size.
+ *
+ * PNG and JPEG images that are larger than the area they are shown in are decoded and scaled
+ * down to a PNG thumbnail, so the bytes sent to the terminal are bounded by the size of the
+ * area rather than the size of the file. Thumbnails are also kept on disk, so that reopening an
+ * image does not decode it again, up to THUMBNAIL_CACHE_BYTES in total.
+ */
+class ImageCache {
+ public:
+  /*
+   * Constructs an image cache that keeps thumbnails in the specified directory, which is
+   * created when the first thumbnail is written. An empty path keeps thumbnails in memory only.
+   */
+  explicit ImageCache(std::filesystem::path thumbnailDirectory = defaultThumbnailDirectory());
+
+  /*
+   * Returns the image at `path`, scaled down to fit within `maxWidth` by `maxHeight` pixels.
+   * The file is read only if it is not cached or has changed since it was cached. Returns
+   * nullptr if the file cannot be read. The same pointer is returned for as long as the file and
+   * size are unchanged, so it identifies the image's contents.
+   */
+  std::shared_ptr<const CachedImage> load(const std::filesystem::path &path, unsigned int maxWidth,
+                                          unsigned int maxHeight);
+
+  /*
+   * Returns the directory that thumbnails are kept in by default: dvim/thumbnails in
+   * $XDG_CACHE_HOME, or in ~/.cache if it is not set. Returns an empty path if neither
+   * $XDG_CACHE_HOME nor $HOME is set.
+   */
+  static std::filesystem::path defaultThumbnailDirectory();
+
+ private:
+  struct Entry {
+    std::filesystem::file_time_type modified;
+    std::uintmax_t size;
+    unsigned int maxWidth;
+    unsigned int maxHeight;
+    uint64_t lastUsed;
+    std::shared_ptr<const CachedImage> image;
+  };
+
+  std::filesystem::path thumbnailDirectory_;
+  std::unordered_map<std::string, Entry> entries_;
+  uint64_t clock_ = 0;
+};
+
+}  // namespace dcurses
+
+#endif
@@ -0,0 +1,572 @@
+// Copyright 2022 Daniel Liu
+
+// Jpeg.cpp
+
+#include "Jpeg.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "Bitmap.hpp"
+
+namespace dcurses {
+
+namespace {
+
+// Huffman codes up to this many bits long are decoded with a single table lookup.
+constexpr unsigned int FAST_BITS = 9;
+
+constexpr double PI = 3.14159265358979323846;
+
+// The position in an 8x8 block of each coefficient, in the zigzag order they are stored in.
+constexpr uint8_t ZIGZAG[64] = {
+  0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20,
+  13, 6, 7, 14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59,
+  52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+uint8_t clampSample(int value) {
+  return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+uint8_t clampSample(float value) {
+  // Truncating rounds negative values the wrong way, but those are clamped to 0 anyway.
+  return clampSample(static_cast<int>(value + 0.5f));
+}
+
+/*
+ * Reads entropy-coded data most significant bit first, removing the zero bytes stuffed after
+ * each 0xff. Stops at the next marker, after which it yields zeros.
+ */
+class BitReader {
+ public:
+  BitReader(std::string_view data, std::size_t position) : data_ {data}, position_ {position} {}
+
+  /*
+   * Returns the next `count` bits, from 1 to 16, without consuming them.
+   */
+  uint32_t peek(unsigned int count) {
+    while (bitCount_ <= 24) {
+      uint32_t byte = 0;
+      if (!atMarker_ && position_ < size(data_)) {
+        byte = static_cast<unsigned char>(data_[position_]);
+        if (byte != 0xff) {
+          ++position_;
+        } else if (position_ + 1 < size(data_) && data_[position_ + 1] == 0) {
+          position_ += 2;
+        } else {
+          atMarker_ = true;
+          byte = 0;
+        }
+      }
+      buffer_ |= byte << (24 - bitCount_);
+      bitCount_ += 8;
+    }
+    return buffer_ >> (32 - count);
+  }
+
+  void consume(unsigned int count) {
+    buffer_ <<= count;
+    bitCount_ -= count;
+  }
+
+  /*
+   * Reads a `count`-bit value and sign-extends it, as coefficients are coded.
+   */
+  int receive(unsigned int count) {
+    if (count == 0) return 0;
+    int value = static_cast<int>(peek(count));
+    consume(count);
+    return value < (1 << (count - 1)) ? value - (1 << count) + 1 : value;
+  }
+
+  /*
+   * Skips to just past the next restart marker, discarding any remaining bits.
+   */
+  void restart() {
+    buffer_ = 0;
+    bitCount_ = 0;
+    atMarker_ = false;
+    while (position_ + 1 < size(data_)) {
+      unsigned char byte = static_cast<unsigned char>(data_[position_]);
+      unsigned char next = static_cast<unsigned char>(data_[position_ + 1]);
+      if (byte == 0xff && next >= 0xd0 && next <= 0xd7) {
+        position_ += 2;
+        return;
+      }
+      if (byte == 0xff && next != 0 && next != 0xff) return;
+      ++position_;
+    }
+  }
+
+  std::size_t position() const { return position_; }
+
+ private:
+  std::string_view data_;
+  std::size_t position_;
+  uint32_t buffer_ = 0;
+  unsigned int bitCount_ = 0;
+  bool atMarker_ = false;
+};
+
+/*
+ * A Huffman table from a DHT segment.
+ */
+class HuffmanTable {
+ public:
+  /*
+   * Builds the table from the number of codes of each length from 1 to 16, and the symbols in
+   * code order. Returns false if the counts do not describe a valid code.
+   */
+  bool build(const uint8_t *counts, const uint8_t *symbols, unsigned int total) {
+    // Reject over-subscribed counts before filling the tables, since the codes of an
+    // over-subscribed length would index past them.
+    int32_t left = 1;
+    for (unsigned int length = 1; length <= 16; ++length) {
+      left = (left << 1) - counts[length - 1];
+      if (left < 0) return false;
+    }
+
+    std::copy(symbols, symbols + total, symbols_);
+    std::fill(std::begin(fastLength_), std::end(fastLength_), uint8_t{0});
+    int32_t code = 0;
+    int32_t index = 0;
+    for (unsigned int length = 1; length <= 16; ++length) {
+      offsets_[length] = index - code;
+      for (unsigned int i = 0; i < counts[length - 1]; ++i, ++code, ++index) {
+        if (code >= (1 << length)) return false;
+        if (length <= FAST_BITS) {
+          uint32_t first = static_cast<uint32_t>(code) << (FAST_BITS - length);
+          for (uint32_t j = first; j < first + (1u << (FAST_BITS - length)); ++j) {
+            fastLength_[j] = static_cast<uint8_t>(length);
+            fastSymbol_[j] = symbols_[index];
+          }
+        }
+      }
+      maxCode_[length] = counts[length - 1] != 0 ? code - 1 : -1;
+      if (code > (1 << length)) return false;
+      code <<= 1;
+    }
+    defined_ = true;
+    return true;
+  }
+
+  /*
+   * Decodes one symbol. Returns -1 if the bits are not a code.
+   */
+  int decode(BitReader &reader) const {
+    uint32_t bits = reader.peek(16);
+    uint32_t fast = bits >> (16 - FAST_BITS);
+    if (fastLength_[fast] != 0) {
+      reader.consume(fastLength_[fast]);
+      return fastSymbol_[fast];
+    }
+    for (unsigned int length = FAST_BITS + 1; length <= 16; ++length) {
+      int32_t code = static_cast<int32_t>(bits >> (16 - length));
+      if (code <= maxCode_[length]) {
+        reader.consume(length);
+        return symbols_[code + offsets_[length]];
+      }
+    }
+    return -1;
+  }
+
+  bool defined() const { return defined_; }
+
+ private:
+  bool defined_ = false;
+  uint8_t fastLength_[1 << FAST_BITS];  // 0 for longer codes.
+  uint8_t fastSymbol_[1 << FAST_BITS];
+  int32_t maxCode_[17];                 // The largest code of each length, or -1.
+  int32_t offsets_[17];                 // Index in symbols_ of a code, minus the code.
+  uint8_t symbols_[256];
+};
+
+struct Component {
+  unsigned int id;
+  unsigned int h;
+  unsigned int v;
+  unsigned int quantTable;
+  unsigned int dcTable = 0;
+  unsigned int acTable = 0;
+  int predictor = 0;
+  std::size_t stride = 0;  // Width of samples, in samples: whole MCUs.
+  std::vector<uint8_t> samples;
+};
+
+/*
+ * The inverse DCT of a block of dequantized coefficients, level shifted back to 0-255 and
+ * written to `out` with the given stride. With a block size of less than 8, only the lowest
+ * frequencies are used, which gives the block scaled down to that size.
+ */
+void inverseDct(const int32_t *coefficients, uint8_t *out, std::size_t stride, unsigned int blockSize) {
+  // A block with only a DC coefficient, which is common, is flat.
+  if (blockSize == 1 || std::all_of(coefficients + 1, coefficients + 64, [](int32_t c) { return c == 0; })) {
+    uint8_t value = clampSample(static_cast<float>(coefficients[0]) / 8.0f + 128.0f);
+    for (unsigned int y = 0; y < blockSize; ++y) {
+      std::fill(out + y * stride, out + y * stride + blockSize, value);
+    }
+    return;
+  }
+
+  // bases[n][x * 8 + u] = C(u) / 2 * cos((2x + 1) * u * pi / 2n), for blocks of size n. The
+  // basis is applied to rows and then to columns.
+  static const auto bases = [] {
+    std::vector<std::vector<float>> bases(9);
+    for (unsigned int n = 2; n <= 8; n *= 2) {
+      bases[n].resize(64);
+      for (unsigned int x = 0; x < n; ++x) {
+        for (unsigned int u = 0; u < n; ++u) {
+          double scale = u == 0 ? std::sqrt(0.5) : 1.0;
+          bases[n][x * 8 + u] = static_cast<float>(scale / 2 * std::cos((2 * x + 1) * u * PI / (2 * n)));
+        }
+      }
+    }
+    return bases;
+  }();
+  const float *basis = bases[blockSize].data();
+
+  // High frequency rows are usually all zero, and contribute nothing.
+  unsigned int usedRows = blockSize;
+  while (usedRows > 1 && std::all_of(coefficients + (usedRows - 1) * 8, coefficients + (usedRows - 1) * 8 + blockSize,
+                                     [](int32_t c) { return c == 0; })) {
+    --usedRows;
+  }
+  float rows[64];
+  for (unsigned int v = 0; v < usedRows; ++v) {
+    for (unsigned int x = 0; x < blockSize; ++x) {
+      float sum = 0;
+      for (unsigned int u = 0; u < blockSize; ++u) {
+        sum += basis[x * 8 + u] * static_cast<float>(coefficients[v * 8 + u]);
+      }
+      rows[v * 8 + x] = sum;
+    }
+  }
+  for (unsigned int y = 0; y < blockSize; ++y) {
+    for (unsigned int x = 0; x < blockSize; ++x) {
+      float sum = 0;
+      for (unsigned int v = 0; v < usedRows; ++v) {
+        sum += basis[y * 8 + v] * rows[v * 8 + x];
+      }
+      out[y * stride + x] = clampSample(sum + 128.0f);
+    }
+  }
+}
+
+/*
+ * Decoder state for one file.
+ */
+class Decoder {
+ public:
+  Decoder(std::string_view data, unsigned int maxWidth, unsigned int maxHeight) :
+    data_ {data}, maxWidth_ {maxWidth}, maxHeight_ {maxHeight} {}
+
+  std::optional<Bitmap> decode() {
+    if (size(data_) < 4 || static_cast<unsigned char>(data_[0]) != 0xff ||
+        static_cast<unsigned char>(data_[1]) != 0xd8) {
+      return std::nullopt;
+    }
+    std::size_t position = 2;
+    bool scanned = false;
+    while (position + 4 <= size(data_)) {
+      if (static_cast<unsigned char>(data_[position]) != 0xff) {
+        ++position;
+        continue;
+      }
+      unsigned int marker = static_cast<unsigned char>(data_[position + 1]);
+      position += 2;
+      // Fill bytes, and markers without a segment.
+      if (marker == 0xff) {
+        --position;
+        continue;
+      }
+      if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8)) continue;
+      if (marker == 0xd9) break;
+
+      std::size_t length = static_cast<unsigned char>(data_[position]) << 8 |
+        static_cast<unsigned char>(data_[position + 1]);
+      if (length < 2 || position + length > size(data_)) return std::nullopt;
+      std::string_view segment = data_.substr(position + 2, length - 2);
+      position += length;
+
+      bool valid = true;
+      if (marker == 0xdb) {
+        valid = readQuantTables(segment);
+      } else if (marker == 0xc4) {
+        valid = readHuffmanTables(segment);
+      } else if (marker == 0xc0 || marker == 0xc1) {
+        valid = readFrame(segment);
+      } else if (marker >= 0xc2 && marker <= 0xcf && marker != 0xc8 && marker != 0xcc) {
+        // Progressive, lossless and arithmetic coded frames.
+        return std::nullopt;
+      } else if (marker == 0xdd) {
+        valid = size(segment) >= 2;
+        if (valid) restartInterval_ = static_cast<unsigned char>(segment[0]) << 8 | static_cast<unsigned char>(segment[1]);
+      } else if (marker == 0xda) {
+        std::optional<std::size_t> end = readScan(segment, position);
+        valid = end.has_value();
+        if (valid) position = *end;
+        scanned = true;
+      }
+      if (!valid) return std::nullopt;
+    }
+    if (!scanned) return std::nullopt;
+    return toRgba();
+  }
+
+ private:
+  static unsigned int byte(std::string_view data, std::size_t index) {
+    return static_cast<unsigned char>(data[index]);
+  }
+
+  bool readQuantTables(std::string_view segment) {
+    while (!segment.empty()) {
+      unsigned int precision = byte(segment, 0) >> 4;
+      unsigned int table = byte(segment, 0) & 15;
+      std::size_t entrySize = precision == 0 ? 1 : 2;
+      if (table > 3 || size(segment) < 1 + 64 * entrySize) return false;
+      for (std::size_t k = 0; k < 64; ++k) {
+        quantTables_[table][k] = static_cast<uint16_t>(precision == 0 ? byte(segment, 1 + k) :
+          byte(segment, 1 + 2 * k) << 8 | byte(segment, 2 + 2 * k));
+      }
+      segment.remove_prefix(1 + 64 * entrySize);
+    }
+    return true;
+  }
+
+  bool readHuffmanTables(std::string_view segment) {
+    while (size(segment) >= 17) {
+      unsigned int tableClass = byte(segment, 0) >> 4;
+      unsigned int table = byte(segment, 0) & 15;
+      if (tableClass > 1 || table > 3) return false;
+      uint8_t counts[16];
+      unsigned int total = 0;
+      for (std::size_t i = 0; i < 16; ++i) {
+        counts[i] = static_cast<uint8_t>(byte(segment, 1 + i));
+        total += counts[i];
+      }
+      if (total > 256 || size(segment) < 17 + total) return false;
+      auto symbols = reinterpret_cast<const uint8_t *>(segment.data() + 17);
+      HuffmanTable &target = tableClass == 0 ? dcTables_[table] : acTables_[table];
+      if (!target.build(counts, symbols, total)) return false;
+      segment.remove_prefix(17 + total);
+    }
+    return segment.empty();
+  }
+
+  bool readFrame(std::string_view segment) {
+    if (size(segment) < 6 || byte(segment, 0) != 8 || !components_.empty()) return false;
+    height_ = byte(segment, 1) << 8 | byte(segment, 2);
+    width_ = byte(segment, 3) << 8 | byte(segment, 4);
+    unsigned int count = byte(segment, 5);
+    if (width_ == 0 || height_ == 0 || static_cast<uint64_t>(width_) * height_ > MAX_IMAGE_PIXELS) return false;
+    if ((count != 1 && count != 3) || size(segment) < 6 + 3 * count) return false;
+    for (unsigned int i = 0; i < count; ++i) {
+      Component component {byte(segment, 6 + 3 * i), byte(segment, 7 + 3 * i) >> 4,
+        byte(segment, 7 + 3 * i) & 15, byte(segment, 8 + 3 * i)};
+      if (component.h == 0 || component.h > 4 || component.v == 0 || component.v > 4 || component.quantTable > 3) {
+        return false;
+      }
+      maxH_ = std::max(maxH_, component.h);
+      maxV_ = std::max(maxV_, component.v);
+      components_.push_back(component);
+    }
+    mcusWide_ = (width_ + 8 * maxH_ - 1) / (8 * maxH_);
+    mcusHigh_ = (height_ + 8 * maxV_ - 1) / (8 * maxV_);
+
+    // Decode each block to as few pixels as still cover the image fitted to the requested size.
+    unsigned int fittedWidth;
+    unsigned int fittedHeight;
+    fittedSize(width_, height_, maxWidth_, maxHeight_, fittedWidth, fittedHeight);
+    while (blockSize_ > 1 && scaled(width_, blockSize_ / 2) >= fittedWidth &&
+           scaled(height_, blockSize_ / 2) >= fittedHeight) {
+      blockSize_ /= 2;
+    }
+    for (Component &component : components_) {
+      component.stride = static_cast<std::size_t>(mcusWide_) * component.h * blockSize_;
+      component.samples.resize(component.stride * mcusHigh_ * component.v * blockSize_);
+    }
+    return true;
+  }
+
+  /*
+   * Reads a scan header and decodes the entropy-coded data after it, which starts at
+   * `position`. Returns the position after the data.
+   */
+  std::optional<std::size_t> readScan(std::string_view segment, std::size_t position) {
+    if (components_.empty() || size(segment) < 1) return std::nullopt;
+    unsigned int count = byte(segment, 0);
+    if (count == 0 || count > 4 || size(segment) < 4 + 2 * count) return std::nullopt;
+    std::vector<Component *> scan;
+    for (unsigned int i = 0; i < count; ++i) {
+      unsigned int id = byte(segment, 1 + 2 * i);
+      auto component = std::find_if(begin(components_), end(components_), [id](const Component &c) { return c.id == id; });
+      if (component == end(components_)) return std::nullopt;
+      component->dcTable = byte(segment, 2 + 2 * i) >> 4;
+      component->acTable = byte(segment, 2 + 2 * i) & 15;
+      if (component->dcTable > 3 || component->acTable > 3 ||
+          !dcTables_[component->dcTable].defined() || !acTables_[component->acTable].defined()) {
+        return std::nullopt;
+      }
+      component->predictor = 0;
+      scan.push_back(&*component);
+    }
+
+    BitReader reader {data_, position};
+    unsigned int mcusDecoded = 0;
+    auto startMcu = [&] {
+      if (restartInterval_ != 0 && mcusDecoded > 0 && mcusDecoded % restartInterval_ == 0) {
+        reader.restart();
+        for (Component *component : scan) component->predictor = 0;
+      }
+      ++mcusDecoded;
+    };
+
+    if (count == 1) {
+      // A single component is stored block by block, covering only the image's own area.
+      Component &component = *scan[0];
+      unsigned int blocksWide = ((width_ * component.h + maxH_ - 1) / maxH_ + 7) / 8;
+      unsigned int blocksHigh = ((height_ * component.v + maxV_ - 1) / maxV_ + 7) / 8;
+      for (unsigned int y = 0; y < blocksHigh; ++y) {
+        for (unsigned int x = 0; x < blocksWide; ++x) {
+          startMcu();
+          if (!decodeBlock(reader, component, x, y)) return std::nullopt;
+        }
+      }
+    } else {
+      for (unsigned int mcuY = 0; mcuY < mcusHigh_; ++mcuY) {
+        for (unsigned int mcuX = 0; mcuX < mcusWide_; ++mcuX) {
+          startMcu();
+          for (Component *component : scan) {
+            for (unsigned int v = 0; v < component->v; ++v) {
+              for (unsigned int h = 0; h < component->h; ++h) {
+                if (!decodeBlock(reader, *component, mcuX * component->h + h, mcuY * component->v + v)) {
+                  return std::nullopt;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+    return reader.position();
+  }
+
+  bool decodeBlock(BitReader &reader, Component &component, unsigned int blockX, unsigned int blockY) {
+    const uint16_t *quant = quantTables_[component.quantTable];
+    int32_t coefficients[64] = {};
+    int category = dcTables_[component.dcTable].decode(reader);
+    if (category < 0 || category > 16) return false;
+    component.predictor += reader.receive(static_cast<unsigned int>(category));
+    coefficients[0] = component.predictor * quant[0];
+
+    const HuffmanTable &ac = acTables_[component.acTable];
+    for (unsigned int k = 1; k < 64;) {
+      int symbol = ac.decode(reader);
+      if (symbol < 0) return false;
+      unsigned int run = static_cast<unsigned int>(symbol) >> 4;
+      unsigned int bits = static_cast<unsigned int>(symbol) & 15;
+      if (bits == 0) {
+        // End of block, or a run of 16 zeros.
+        if (run != 15) break;
+        k += 16;
+        continue;
+      }
+      k += run;
+      if (k > 63) return false;
+      coefficients[ZIGZAG[k]] = reader.receive(bits) * quant[k];
+      ++k;
+    }
+
+    std::size_t offset = (static_cast<std::size_t>(blockY) * component.stride + blockX) * blockSize_;
+    if (offset + (blockSize_ - 1) * component.stride + blockSize_ > component.samples.size()) return false;
+    inverseDct(coefficients, component.samples.data() + offset, component.stride, blockSize_);
+    return true;
+  }
+
+  /*
+   * Returns a length of the image in pixels, when each block is decoded to `blockSize` pixels.
+   */
+  static unsigned int scaled(unsigned int length, unsigned int blockSize) {
+    return (length * blockSize + 7) / 8;
+  }
+
+  Bitmap toRgba() const {
+    unsigned int width = scaled(width_, blockSize_);
+    unsigned int height = scaled(height_, blockSize_);
+    Bitmap bitmap {width, height, std::vector<uint8_t>(static_cast<std::size_t>(width) * height * 4)};
+    // Components with the ids 'R', 'G' and 'B' are stored as RGB rather than YCbCr.
+    bool rgb = size(components_) == 3 && components_[0].id == 'R' && components_[1].id == 'G' &&
+      components_[2].id == 'B';
+    // The sample column each pixel column comes from, for each component.
+    std::vector<unsigned int> columns[3];
+    for (std::size_t c = 0; c < size(components_); ++c) {
+      columns[c].resize(width);
+      for (unsigned int x = 0; x < width; ++x) {
+        columns[c][x] = x * components_[c].h / maxH_;
+      }
+    }
+    uint8_t *out = bitmap.pixels.data();
+    for (unsigned int y = 0; y < height; ++y) {
+      const uint8_t *rows[3];
+      for (std::size_t c = 0; c < size(components_); ++c) {
+        const Component &component = components_[c];
+        rows[c] = component.samples.data() + static_cast<std::size_t>(y * component.v / maxV_) * component.stride;
+      }
+      for (unsigned int x = 0; x < width; ++x, out += 4) {
+        out[3] = 255;
+        if (size(components_) == 1) {
+          out[0] = out[1] = out[2] = rows[0][x];
+          continue;
+        }
+        int values[3];
+        for (std::size_t c = 0; c < 3; ++c) {
+          values[c] = rows[c][columns[c][x]];
+        }
+        if (rgb) {
+          for (std::size_t c = 0; c < 3; ++c) out[c] = static_cast<uint8_t>(values[c]);
+          continue;
+        }
+        // The JFIF conversion, in 16.16 fixed point.
+        int luma = values[0];
+        int cb = values[1] - 128;
+        int cr = values[2] - 128;
+        out[0] = clampSample(luma + ((91881 * cr + 32768) >> 16));
+        out[1] = clampSample(luma - ((22554 * cb + 46802 * cr + 32768) >> 16));
+        out[2] = clampSample(luma + ((116130 * cb + 32768) >> 16));
+      }
+    }
+    return bitmap;
+  }
+
+  std::string_view data_;
+  unsigned int maxWidth_;
+  unsigned int maxHeight_;
+  unsigned int blockSize_ = 8;
+  uint16_t quantTables_[4][64] = {};
+  HuffmanTable dcTables_[4];
+  HuffmanTable acTables_[4];
+  std::vector<Component> components_;
+  unsigned int width_ = 0;
+  unsigned int height_ = 0;
+  unsigned int maxH_ = 1;
+  unsigned int maxV_ = 1;
+  unsigned int mcusWide_ = 0;
+  unsigned int mcusHigh_ = 0;
+  unsigned int restartInterval_ = 0;
+};
+
+}  // namespace
+
+std::optional<Bitmap> decodeJpeg(std::string_view data, unsigned int maxWidth, unsigned int maxHeight) {
+  // The decoder's tables are large, so it lives on the heap.
+  auto decoder = std::make_unique<Decoder>(data, maxWidth, maxHeight);
+  return decoder->decode();
+}
+
+}  // namespace dcurses
@@ -0,0 +1,37 @@
+// Copyright 2022 Daniel Liu
+
+// Jpeg.hpp
+// JPEG decoding.
+
+#ifndef DCURSES_JPEG_HPP_
+#define DCURSES_JPEG_HPP_
+
+#include <climits>
+#include <optional>
+#include <string_view>
+
+#include "Bitmap.hpp"
+
+namespace dcurses {
+
+/*
+ * Decodes a baseline (sequential, Huffman coded) JPEG file with one or three components, at any
+ * chroma subsampling. Chroma is upsampled by repeating samples, which is enough for images that
+ * are scaled down for display.
+ *
+ * When the image is to be scaled down to fit within `maxWidth` by `maxHeight` pixels, it is
+ * decoded at 1/2, 1/4 or 1/8 scale straight from its DCT coefficients, which is much faster than
+ * decoding it in full. The smallest scale that is still at least as large as the fitted image
+ * is used, so the result should still be passed to fitWithin.
+ * @param data The contents of the file.
+ * @param maxWidth The width the image will be fitted to, in pixels.
+ * @param maxHeight The height the image will be fitted to, in pixels.
+ * @return The decoded image, or std::nullopt if the file is not a valid baseline JPEG (for
+ *   example, a progressive or CMYK one) or is larger than MAX_IMAGE_PIXELS.
+ */
+std::optional<Bitmap> decodeJpeg(std::string_view data, unsigned int maxWidth = UINT_MAX,
+                                 unsigned int maxHeight = UINT_MAX);
+
+}  // namespace dcurses
+
+#endif
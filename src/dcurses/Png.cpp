@@ -0,0 +1,365 @@
+// Copyright 2022 Daniel Liu
+
+// Png.cpp
+
+#include "Png.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Bitmap.hpp"
+#include "Zlib.hpp"
+
+namespace dcurses {
+
+namespace {
+
+constexpr std::string_view SIGNATURE {"\x89PNG\r\n\x1a\n", 8};
+
+/*
+ * The pixels of each Adam7 interlacing pass: columns x0, x0 + dx, ... and rows y0, y0 + dy, ...
+ */
+struct Pass {
+  unsigned int x0;
+  unsigned int y0;
+  unsigned int dx;
+  unsigned int dy;
+};
+constexpr Pass ADAM7[7] = {
+  {0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}};
+
+uint32_t readBigEndian(std::string_view data, std::size_t offset) {
+  uint32_t value = 0;
+  for (std::size_t i = 0; i < 4; ++i) {
+    value = value << 8 | static_cast<unsigned char>(data[offset + i]);
+  }
+  return value;
+}
+
+void appendBigEndian(std::string &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out += static_cast<char>((value >> shift) & 0xff);
+  }
+}
+
+uint32_t crc32(std::string_view data) {
+  static const auto table = [] {
+    std::vector<uint32_t> table(256);
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+    return table;
+  }();
+  uint32_t crc = 0xffffffffu;
+  for (char byte : data) {
+    crc = table[(crc ^ static_cast<unsigned char>(byte)) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffffu;
+}
+
+void appendChunk(std::string &out, std::string_view type, std::string_view data) {
+  appendBigEndian(out, static_cast<uint32_t>(size(data)));
+  std::size_t start = size(out);
+  out.append(type);
+  out.append(data);
+  appendBigEndian(out, crc32(std::string_view{out}.substr(start)));
+}
+
+uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+/*
+ * Reverses the filter of one row in place. `previous` is the unfiltered row above, and `bpp`
+ * the number of bytes per complete pixel (at least 1).
+ */
+bool unfilterRow(uint8_t filter, uint8_t *row, const uint8_t *previous, std::size_t length, std::size_t bpp) {
+  switch (filter) {
+    case 0:
+      return true;
+    case 1:
+      for (std::size_t i = bpp; i < length; ++i) row[i] = static_cast<uint8_t>(row[i] + row[i - bpp]);
+      return true;
+    case 2:
+      for (std::size_t i = 0; i < length; ++i) row[i] = static_cast<uint8_t>(row[i] + previous[i]);
+      return true;
+    case 3:
+      for (std::size_t i = 0; i < length; ++i) {
+        unsigned int left = i >= bpp ? row[i - bpp] : 0;
+        row[i] = static_cast<uint8_t>(row[i] + ((left + previous[i]) >> 1));
+      }
+      return true;
+    case 4:
+      for (std::size_t i = 0; i < length; ++i) {
+        uint8_t left = i >= bpp ? row[i - bpp] : 0;
+        uint8_t upperLeft = i >= bpp ? previous[i - bpp] : 0;
+        row[i] = static_cast<uint8_t>(row[i] + paeth(left, previous[i], upperLeft));
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*
+ * The layout of a PNG's pixel data, from its header.
+ */
+struct Format {
+  unsigned int depth;
+  unsigned int colorType;
+  unsigned int channels;
+  std::vector<uint8_t> palette;  // RGBA entries, for color type 3.
+
+  std::size_t rowBytes(unsigned int width) const {
+    return (static_cast<std::size_t>(width) * channels * depth + 7) / 8;
+  }
+
+  /*
+   * Returns sample `channel` of pixel `x` in an unfiltered row, unscaled.
+   */
+  unsigned int sample(const uint8_t *row, unsigned int x, unsigned int channel) const {
+    std::size_t index = static_cast<std::size_t>(x) * channels + channel;
+    if (depth == 8) return row[index];
+    if (depth == 16) return row[index * 2];
+    std::size_t bit = index * depth;
+    return (row[bit / 8] >> (8 - depth - bit % 8)) & ((1u << depth) - 1);
+  }
+
+  /*
+   * Converts one unfiltered row to RGBA.
+   */
+  void toRgba(const uint8_t *row, unsigned int width, uint8_t *out) const {
+    // Gray samples of less than 8 bits are scaled up to the full range.
+    unsigned int grayScale = depth < 8 ? 255 / ((1u << depth) - 1) : 1;
+    for (unsigned int x = 0; x < width; ++x, out += 4) {
+      switch (colorType) {
+        case 0:
+          out[0] = out[1] = out[2] = static_cast<uint8_t>(sample(row, x, 0) * grayScale);
+          out[3] = 255;
+          break;
+        case 2:
+          for (unsigned int c = 0; c < 3; ++c) out[c] = static_cast<uint8_t>(sample(row, x, c));
+          out[3] = 255;
+          break;
+        case 3: {
+          std::size_t entry = sample(row, x, 0) * std::size_t{4};
+          for (unsigned int c = 0; c < 4; ++c) {
+            out[c] = entry + c < size(palette) ? palette[entry + c] : (c == 3 ? 255 : 0);
+          }
+          break;
+        }
+        case 4:
+          out[0] = out[1] = out[2] = static_cast<uint8_t>(sample(row, x, 0));
+          out[3] = static_cast<uint8_t>(sample(row, x, 1));
+          break;
+        default:
+          for (unsigned int c = 0; c < 4; ++c) out[c] = static_cast<uint8_t>(sample(row, x, c));
+          break;
+      }
+    }
+  }
+};
+
+/*
+ * Unfilters the rows of one image (or interlacing pass) in place, and converts each to RGBA.
+ * `data` holds `height` rows, each a filter type byte followed by the filtered row. Calls
+ * `emit(y, rgbaRow)` for each row. Returns the number of bytes consumed, or 0 on error.
+ */
+template <typename F>
+std::size_t decodeRows(const Format &format, uint8_t *data, std::size_t available, unsigned int width,
+                       unsigned int height, std::vector<uint8_t> &rgba, F emit) {
+  std::size_t rowBytes = format.rowBytes(width);
+  std::size_t bpp = std::max<std::size_t>(format.channels * format.depth / 8, 1);
+  if (available / (rowBytes + 1) < height) return 0;
+  std::vector<uint8_t> zeros(rowBytes);
+  const uint8_t *previous = zeros.data();
+  rgba.resize(static_cast<std::size_t>(width) * 4);
+  for (unsigned int y = 0; y < height; ++y) {
+    uint8_t *row = data + y * (rowBytes + 1);
+    if (!unfilterRow(row[0], row + 1, previous, rowBytes, bpp)) return 0;
+    format.toRgba(row + 1, width, rgba.data());
+    emit(y, rgba.data());
+    previous = row + 1;
+  }
+  return height * (rowBytes + 1);
+}
+
+}  // namespace
+
+bool readPngSize(std::string_view data, unsigned int &width, unsigned int &height) {
+  // The IHDR chunk always comes first.
+  if (size(data) < 24 || data.substr(0, 8) != SIGNATURE || data.substr(12, 4) != "IHDR") return false;
+  width = readBigEndian(data, 16);
+  height = readBigEndian(data, 20);
+  return true;
+}
+
+std::optional<Bitmap> decodePng(std::string_view data) {
+  Bitmap bitmap;
+  if (!readPngSize(data, bitmap.width, bitmap.height) || size(data) < 33) return std::nullopt;
+  if (bitmap.width == 0 || bitmap.height == 0 ||
+      static_cast<uint64_t>(bitmap.width) * bitmap.height > MAX_IMAGE_PIXELS) {
+    return std::nullopt;
+  }
+  Format format {static_cast<unsigned char>(data[24]), static_cast<unsigned char>(data[25]), 0, {}};
+  bool interlaced = data[28] != 0;
+  switch (format.colorType) {
+    case 0: format.channels = 1; break;
+    case 2: format.channels = 3; break;
+    case 3: format.channels = 1; break;
+    case 4: format.channels = 2; break;
+    case 6: format.channels = 4; break;
+    default: return std::nullopt;
+  }
+  bool validDepth = format.colorType == 0 ? format.depth <= 16 && (format.depth & (format.depth - 1)) == 0 :
+    format.colorType == 3 ? format.depth <= 8 && (format.depth & (format.depth - 1)) == 0 :
+    format.depth == 8 || format.depth == 16;
+  if (!validDepth || format.depth == 0) return std::nullopt;
+
+  std::string compressed;
+  for (std::size_t position = 8; position + 12 <= size(data);) {
+    uint32_t length = readBigEndian(data, position);
+    if (length > size(data) - position - 12) return std::nullopt;
+    std::string_view type = data.substr(position + 4, 4);
+    std::string_view chunk = data.substr(position + 8, length);
+    position += 12 + length;
+    if (type == "IDAT") {
+      compressed.append(chunk);
+    } else if (type == "PLTE") {
+      for (std::size_t i = 0; i + 3 <= size(chunk); i += 3) {
+        format.palette.insert(end(format.palette), {
+          static_cast<uint8_t>(chunk[i]), static_cast<uint8_t>(chunk[i + 1]), static_cast<uint8_t>(chunk[i + 2]), 255});
+      }
+    } else if (type == "tRNS" && format.colorType == 3) {
+      for (std::size_t i = 0; i < size(chunk) && i * 4 + 3 < size(format.palette); ++i) {
+        format.palette[i * 4 + 3] = static_cast<uint8_t>(chunk[i]);
+      }
+    } else if (type == "IEND") {
+      break;
+    }
+  }
+
+  std::size_t expected = 0;
+  if (interlaced) {
+    for (const Pass &pass : ADAM7) {
+      std::size_t width = (bitmap.width + pass.dx - 1 - pass.x0) / pass.dx;
+      std::size_t height = (bitmap.height + pass.dy - 1 - pass.y0) / pass.dy;
+      if (width > 0 && height > 0) expected += height * (format.rowBytes(static_cast<unsigned int>(width)) + 1);
+    }
+  } else {
+    expected = bitmap.height * (format.rowBytes(bitmap.width) + 1);
+  }
+  auto raw = zlibDecompress(compressed, expected);
+  if (!raw || size(*raw) < expected) return std::nullopt;
+
+  auto *bytes = reinterpret_cast<uint8_t *>(raw->data());
+  bitmap.pixels.resize(static_cast<std::size_t>(bitmap.width) * bitmap.height * 4);
+  std::vector<uint8_t> rgba;
+  if (!interlaced) {
+    std::size_t rowSize = static_cast<std::size_t>(bitmap.width) * 4;
+    bool decoded = decodeRows(format, bytes, size(*raw), bitmap.width, bitmap.height, rgba,
+      [&bitmap, rowSize](unsigned int y, const uint8_t *row) {
+        std::copy(row, row + rowSize, bitmap.pixels.data() + y * rowSize);
+      }) != 0;
+    if (!decoded) return std::nullopt;
+    return bitmap;
+  }
+
+  // Each pass is a separate, smaller image, whose pixels are spread over the full image.
+  std::size_t offset = 0;
+  for (const Pass &pass : ADAM7) {
+    if (pass.x0 >= bitmap.width || pass.y0 >= bitmap.height) continue;
+    unsigned int width = (bitmap.width + pass.dx - 1 - pass.x0) / pass.dx;
+    unsigned int height = (bitmap.height + pass.dy - 1 - pass.y0) / pass.dy;
+    std::size_t consumed = decodeRows(format, bytes + offset, size(*raw) - offset, width, height, rgba,
+      [&bitmap, &pass, width](unsigned int y, const uint8_t *row) {
+        uint8_t *out = bitmap.pixels.data() + (static_cast<std::size_t>(pass.y0 + y * pass.dy) * bitmap.width + pass.x0) * 4;
+        for (unsigned int x = 0; x < width; ++x, out += pass.dx * 4) {
+          std::copy(row + x * 4, row + x * 4 + 4, out);
+        }
+      });
+    if (consumed == 0) return std::nullopt;
+    offset += consumed;
+  }
+  return bitmap;
+}
+
+std::string encodePng(const Bitmap &bitmap) {
+  bool opaque = true;
+  for (std::size_t i = 3; i < size(bitmap.pixels); i += 4) {
+    if (bitmap.pixels[i] != 255) {
+      opaque = false;
+      break;
+    }
+  }
+  std::size_t bpp = opaque ? 3 : 4;
+  std::size_t rowBytes = bitmap.width * bpp;
+
+  // Each row gets whichever filter leaves the smallest sum of absolute values, which tends to
+  // compress best.
+  std::string filtered;
+  filtered.reserve((rowBytes + 1) * bitmap.height);
+  std::vector<uint8_t> previous(rowBytes);
+  std::vector<uint8_t> current(rowBytes);
+  std::vector<uint8_t> candidates[5];
+  for (auto &candidate : candidates) candidate.resize(rowBytes);
+  for (unsigned int y = 0; y < bitmap.height; ++y) {
+    const uint8_t *pixel = bitmap.pixels.data() + static_cast<std::size_t>(y) * bitmap.width * 4;
+    for (unsigned int x = 0; x < bitmap.width; ++x) {
+      std::copy(pixel + x * 4, pixel + x * 4 + bpp, current.data() + x * bpp);
+    }
+    for (std::size_t i = 0; i < rowBytes; ++i) {
+      uint8_t left = i >= bpp ? current[i - bpp] : 0;
+      uint8_t upperLeft = i >= bpp ? previous[i - bpp] : 0;
+      candidates[0][i] = current[i];
+      candidates[1][i] = static_cast<uint8_t>(current[i] - left);
+      candidates[2][i] = static_cast<uint8_t>(current[i] - previous[i]);
+      candidates[3][i] = static_cast<uint8_t>(current[i] - ((left + previous[i]) >> 1));
+      candidates[4][i] = static_cast<uint8_t>(current[i] - paeth(left, previous[i], upperLeft));
+    }
+    std::size_t best = 0;
+    uint64_t bestCost = UINT64_MAX;
+    for (std::size_t filter = 0; filter < 5; ++filter) {
+      uint64_t cost = 0;
+      for (uint8_t byte : candidates[filter]) cost += static_cast<uint64_t>(std::abs(static_cast<int8_t>(byte)));
+      if (cost < bestCost) {
+        best = filter;
+        bestCost = cost;
+      }
+    }
+    filtered += static_cast<char>(best);
+    filtered.append(reinterpret_cast<const char *>(candidates[best].data()), rowBytes);
+    std::swap(previous, current);
+  }
+
+  std::string header;
+  appendBigEndian(header, bitmap.width);
+  appendBigEndian(header, bitmap.height);
+  // 8-bit samples, RGB or RGBA, deflate, adaptive filtering, no interlacing.
+  header += static_cast<char>(8);
+  header += static_cast<char>(opaque ? 2 : 6);
+  header.append(3, '\0');
+
+  std::string png {SIGNATURE};
+  appendChunk(png, "IHDR", header);
+  appendChunk(png, "IDAT", zlibCompress(filtered));
+  appendChunk(png, "IEND", "");
+  return png;
+}
+
+}  // namespace dcurses
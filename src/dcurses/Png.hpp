@@ -0,0 +1,41 @@
+// Copyright 2022 Daniel Liu
+
+// Png.hpp
+// PNG decoding and encoding.
+
+#ifndef DCURSES_PNG_HPP_
+#define DCURSES_PNG_HPP_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "Bitmap.hpp"
+
+namespace dcurses {
+
+/*
+ * Decodes a PNG file. Every color type, bit depth and interlace method is supported; 16-bit
+ * samples are reduced to 8 bits.
+ * @param data The contents of the file.
+ * @return The decoded image, or std::nullopt if the file is not a valid PNG or is larger than
+ *   MAX_IMAGE_PIXELS.
+ */
+std::optional<Bitmap> decodePng(std::string_view data);
+
+/*
+ * Reads the size of a PNG image from its header, without decoding it.
+ * @return false if the data does not start with a PNG header.
+ */
+bool readPngSize(std::string_view data, unsigned int &width, unsigned int &height);
+
+/*
+ * Encodes a bitmap as a PNG file, in RGB if every pixel is opaque and in RGBA otherwise.
+ * @param bitmap The image to encode.
+ * @return The contents of the PNG file.
+ */
+std::string encodePng(const Bitmap &bitmap);
+
+}  // namespace dcurses
+
+#endif
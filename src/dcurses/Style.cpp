@@ -0,0 +1,163 @@
+// Copyright 2022 Daniel Liu
+
+// Style.cpp
+
+#include "Style.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace dcurses {
+
+namespace {
+
+// SGR codes that set each attribute flag, and that clear it. Bold and dim share 22.
+constexpr unsigned int FLAG_ON[8] = {1, 2, 3, 4, 5, 7, 8, 9};
+constexpr unsigned int FLAG_OFF[8] = {22, 22, 23, 24, 25, 27, 28, 29};
+
+/*
+ * Appends SGR parameters to a fixed buffer, separated by semicolons.
+ */
+class ParameterWriter {
+ public:
+  explicit ParameterWriter(char *out) : out_ {out} {}
+
+  void add(unsigned int number) {
+    if (length_ > 0) out_[length_++] = ';';
+    char digits[10];
+    std::size_t count = 0;
+    do {
+      digits[count++] = static_cast<char>('0' + number % 10);
+      number /= 10;
+    } while (number != 0);
+    while (count > 0) {
+      out_[length_++] = digits[--count];
+    }
+  }
+
+  /*
+   * Adds the parameters that select a color. `base` is 30 for foreground and 40 for background.
+   */
+  void addColor(uint32_t color, unsigned int base) {
+    if (color == Style::DEFAULT_COLOR) {
+      add(base + 9);
+    } else if ((color & Style::RGB_COLOR) != 0) {
+      add(base + 8);
+      add(2);
+      add((color >> 16) & 0xff);
+      add((color >> 8) & 0xff);
+      add(color & 0xff);
+    } else {
+      unsigned int index = color & 0xff;
+      if (index < 8) {
+        add(base + index);
+      } else if (index < 16) {
+        add(base + 60 + index - 8);
+      } else {
+        add(base + 8);
+        add(5);
+        add(index);
+      }
+    }
+  }
+
+  std::size_t length() const { return length_; }
+
+ private:
+  char *out_;
+  std::size_t length_ = 0;
+};
+
+}  // namespace
+
+void applySgr(Style &style, std::string_view parameters) {
+  unsigned int values[32];
+  std::size_t count = 0;
+  unsigned int value = 0;
+  for (char c : parameters) {
+    if (c >= '0' && c <= '9') {
+      value = value * 10 + static_cast<unsigned int>(c - '0');
+    } else if (c == ';' || c == ':') {
+      if (count < 32) values[count++] = value;
+      value = 0;
+    }
+  }
+  if (count < 32) values[count++] = value;
+
+  for (std::size_t i = 0; i < count; ++i) {
+    unsigned int code = values[i];
+    if (code == 0) {
+      style = Style{};
+    } else if (code >= 1 && code <= 9 && code != 6) {
+      style.flags = static_cast<uint8_t>(style.flags | (1 << (code < 6 ? code - 1 : code - 2)));
+    } else if (code == 22) {
+      style.flags = static_cast<uint8_t>(style.flags & ~(Style::BOLD | Style::DIM));
+    } else if (code >= 23 && code <= 29 && code != 26) {
+      style.flags = static_cast<uint8_t>(style.flags & ~(1 << (code < 26 ? code - 21 : code - 22)));
+    } else if ((code >= 30 && code <= 37) || (code >= 40 && code <= 47)) {
+      uint32_t &color = code < 40 ? style.foreground : style.background;
+      color = Style::INDEXED_COLOR | (code % 10);
+    } else if ((code >= 90 && code <= 97) || (code >= 100 && code <= 107)) {
+      uint32_t &color = code < 100 ? style.foreground : style.background;
+      color = Style::INDEXED_COLOR | (code % 10 + 8);
+    } else if (code == 39) {
+      style.foreground = Style::DEFAULT_COLOR;
+    } else if (code == 49) {
+      style.background = Style::DEFAULT_COLOR;
+    } else if (code == 38 || code == 48) {
+      uint32_t &color = code == 38 ? style.foreground : style.background;
+      if (i + 2 < count && values[i + 1] == 5) {
+        color = Style::INDEXED_COLOR | (values[i + 2] & 0xff);
+        i += 2;
+      } else if (i + 4 < count && values[i + 1] == 2) {
+        color = Style::RGB_COLOR | ((values[i + 2] & 0xff) << 16) | ((values[i + 3] & 0xff) << 8) |
+          (values[i + 4] & 0xff);
+        i += 4;
+      } else {
+        break;
+      }
+    }
+  }
+}
+
+std::size_t encodeSgrTransition(const Style &from, const Style &to, char *out) {
+  // Either reset and set everything in `to`, or change only what differs, whichever is shorter.
+  char reset[SGR_BUFFER_SIZE];
+  ParameterWriter resetWriter {reset};
+  if (to != Style{}) {
+    resetWriter.add(0);
+    for (unsigned int flag = 0; flag < 8; ++flag) {
+      if (to.flags & (1 << flag)) resetWriter.add(FLAG_ON[flag]);
+    }
+    if (to.foreground != Style::DEFAULT_COLOR) resetWriter.addColor(to.foreground, 30);
+    if (to.background != Style::DEFAULT_COLOR) resetWriter.addColor(to.background, 40);
+  }
+
+  ParameterWriter diffWriter {out};
+  uint8_t removed = static_cast<uint8_t>(from.flags & ~to.flags);
+  uint8_t added = static_cast<uint8_t>(to.flags & ~from.flags);
+  if (removed & (Style::BOLD | Style::DIM)) {
+    // 22 clears both bold and dim, so whichever should stay has to be set again.
+    diffWriter.add(22);
+    added = static_cast<uint8_t>(added | (to.flags & (Style::BOLD | Style::DIM)));
+  }
+  for (unsigned int flag = 2; flag < 8; ++flag) {
+    if (removed & (1 << flag)) diffWriter.add(FLAG_OFF[flag]);
+  }
+  for (unsigned int flag = 0; flag < 8; ++flag) {
+    if (added & (1 << flag)) diffWriter.add(FLAG_ON[flag]);
+  }
+  if (from.foreground != to.foreground) diffWriter.addColor(to.foreground, 30);
+  if (from.background != to.background) diffWriter.addColor(to.background, 40);
+
+  if (resetWriter.length() < diffWriter.length()) {
+    for (std::size_t i = 0; i < resetWriter.length(); ++i) {
+      out[i] = reset[i];
+    }
+    return resetWriter.length();
+  }
+  return diffWriter.length();
+}
+
+}  // namespace dcurses
@@ -0,0 +1,72 @@
+// Copyright 2022 Daniel Liu
+
+// Style.hpp
+// Cell styles, parsed from and encoded to SGR escape sequences.
+
+#ifndef DCURSES_STYLE_HPP_
+#define DCURSES_STYLE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace dcurses {
+
+/*
+ * The graphic rendition of a cell: foreground and background colors, and text attributes.
+ *
+ * Colors are packed into 32 bits: DEFAULT_COLOR, INDEXED_COLOR | index (0-255), or
+ * RGB_COLOR | 0xrrggbb.
+ */
+struct Style {
+  static constexpr uint32_t DEFAULT_COLOR = 0;
+  static constexpr uint32_t INDEXED_COLOR = 0x01000000u;
+  static constexpr uint32_t RGB_COLOR = 0x02000000u;
+
+  /*
+   * Attribute flags, in the order of their SGR codes (1-9, skipping 6).
+   */
+  static constexpr uint8_t BOLD = 1 << 0;
+  static constexpr uint8_t DIM = 1 << 1;
+  static constexpr uint8_t ITALIC = 1 << 2;
+  static constexpr uint8_t UNDERLINE = 1 << 3;
+  static constexpr uint8_t BLINK = 1 << 4;
+  static constexpr uint8_t REVERSE = 1 << 5;
+  static constexpr uint8_t HIDDEN = 1 << 6;
+  static constexpr uint8_t STRIKETHROUGH = 1 << 7;
+
+  uint32_t foreground = DEFAULT_COLOR;
+  uint32_t background = DEFAULT_COLOR;
+  uint8_t flags = 0;
+
+  bool operator==(const Style &other) const {
+    return foreground == other.foreground && background == other.background && flags == other.flags;
+  }
+  bool operator!=(const Style &other) const { return !(*this == other); }
+
+  /*
+   * Returns a single integer uniquely identifying the style.
+   */
+  uint64_t key() const {
+    return (static_cast<uint64_t>(flags) << 52) | (static_cast<uint64_t>(foreground) << 26) | background;
+  }
+};
+
+/*
+ * Applies the parameters of an SGR sequence (the part between ESC[ and m) to a style.
+ * Unsupported parameters are ignored.
+ */
+void applySgr(Style &style, std::string_view parameters);
+
+/*
+ * Writes the parameters of the shortest SGR sequence that changes the terminal from style `from`
+ * to style `to` into `out`, which must hold at least SGR_BUFFER_SIZE bytes. Returns the number
+ * of bytes written; 0 means the sequence has no parameters (a full reset).
+ */
+std::size_t encodeSgrTransition(const Style &from, const Style &to, char *out);
+
+#define SGR_BUFFER_SIZE 128
+
+}  // namespace dcurses
+
+#endif
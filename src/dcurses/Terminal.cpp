@@ -0,0 +1,271 @@
+// Copyright 2022 Daniel Liu
+
+// Terminal.cpp
+
+#include "Terminal.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace dcurses {
+
+namespace {
+
+// Leaves the alternate screen, after ending any synchronized update and showing the cursor.
+constexpr std::string_view RESTORE_SEQUENCE = "\33[?2026l\33[0m\33[?25h\33[?1049l";
+
+// Asks whether synchronized output (DEC private mode 2026) is recognized (DECRQM), whether the
+// kitty graphics protocol is supported (a query action for a 1x1 image), and for the name of the
+// terminal (XTVERSION).
+constexpr std::string_view FEATURE_QUERY = "\33[?2026$p"
+                                           "\33_Gi=31,s=1,v=1,a=q,t=d,f=24;AAAA\33\\"
+                                           "\33[>0q";
+
+// Asks for the size of a character cell in pixels (XTWINOPS 16).
+constexpr std::string_view CELL_SIZE_QUERY = "\33[16t";
+
+/*
+ * Returns true if the reply to DECRQM, ESC[?<mode>;<value>$y, says the mode is recognized.
+ * A value of 0 or 4 means the mode is unsupported.
+ */
+bool privateModeSupported(const std::string &reply, unsigned int mode) {
+  std::string prefix = "\33[?" + std::to_string(mode) + ";";
+  auto start = reply.find(prefix);
+  if (start == std::string::npos || start + size(prefix) >= size(reply)) return false;
+  char value = reply[start + size(prefix)];
+  return value != '0' && value != '4';
+}
+
+/*
+ * Returns true if the environment variable is set to the specified value.
+ */
+bool environmentIs(const char *name, std::string_view value) {
+  const char *variable = std::getenv(name);
+  return variable != nullptr && variable == value;
+}
+
+}  // namespace
+
+TtyTerminal::TtyTerminal() {
+  if (tcgetattr(STDIN_FILENO, &savedTermios_) == -1) {
+    std::cout << "standard input is not a terminal" << std::endl;
+    exit(1);
+  }
+  struct termios raw = savedTermios_;
+  cfmakeraw(&raw);
+  if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1) {
+    std::cout << "could not enter raw mode" << std::endl;
+    exit(1);
+  }
+  raw_ = 1;
+
+  struct sigaction fatalAction = {};
+  fatalAction.sa_handler = handleFatalSignal;
+  sigemptyset(&fatalAction.sa_mask);
+  fatalAction.sa_flags = SA_RESETHAND;
+  for (std::size_t i = 0; i < std::size(FATAL_SIGNALS); ++i) {
+    sigaction(FATAL_SIGNALS[i], &fatalAction, &previousFatalActions_[i]);
+  }
+
+  // Save the cursor and switch to the alternate screen.
+  write("\33[?1049h");
+
+  struct winsize w = {};
+  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+  width_ = w.ws_col;
+  height_ = w.ws_row;
+
+  if (pipe(resizePipe_) == 0) {
+    for (int fd : resizePipe_) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    struct sigaction action = {};
+    action.sa_handler = handleResizeSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &action, &previousResizeAction_);
+  }
+
+  // Ask everything at once, so that startup waits for a single round trip.
+  bool knowCellSize = updateCellSize(w);
+  std::string reply = query(std::string{FEATURE_QUERY} + std::string{knowCellSize ? "" : CELL_SIZE_QUERY});
+  synchronizedOutput_ = privateModeSupported(reply, 2026);
+  // A terminal that supports the protocol answers ESC_Gi=31;OK ESC\ without storing the image.
+  // Others ignore the APC sequence.
+  kittyGraphics_ = reply.find("\33_Gi=31;OK") != std::string::npos;
+  // iTerm2 names itself in its reply to XTVERSION, ESC P>|iTerm2 <version> ESC\, and in the
+  // environment of local shells.
+  iterm2Images_ = reply.find("\33P>|iTerm2") != std::string::npos || environmentIs("LC_TERMINAL", "iTerm2") ||
+                  environmentIs("TERM_PROGRAM", "iTerm.app");
+  if (!knowCellSize) {
+    // The reply is ESC[6;<height>;<width>t.
+    unsigned int height = 0;
+    unsigned int width = 0;
+    auto start = reply.find("\33[6;");
+    if (start != std::string::npos && sscanf(reply.c_str() + start, "\33[6;%u;%ut", &height, &width) == 2 &&
+        height != 0 && width != 0) {
+      cellPixelWidth_ = width;
+      cellPixelHeight_ = height;
+    }
+  }
+}
+
+struct termios TtyTerminal::savedTermios_;
+volatile sig_atomic_t TtyTerminal::raw_ = 0;
+
+void TtyTerminal::restore() {
+  if (!raw_) return;
+  raw_ = 0;
+  if (::write(STDOUT_FILENO, RESTORE_SEQUENCE.data(), size(RESTORE_SEQUENCE)) == -1) {}
+  tcsetattr(STDIN_FILENO, TCSADRAIN, &savedTermios_);
+}
+
+void TtyTerminal::handleFatalSignal(int signal) {
+  restore();
+  raise(signal);
+}
+
+int TtyTerminal::resizePipe_[2] = {-1, -1};
+
+void TtyTerminal::handleResizeSignal(int) {
+  int savedErrno = errno;
+  char byte = 0;
+  // If the pipe is full, a resize is already pending.
+  if (::write(resizePipe_[1], &byte, 1) == -1) {}
+  errno = savedErrno;
+}
+
+bool TtyTerminal::updateSize() {
+  char buf[64];
+  bool signalled = false;
+  while (read(resizePipe_[0], buf, sizeof(buf)) > 0) {
+    signalled = true;
+  }
+  if (!signalled) return false;
+
+  struct winsize w;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == -1) return false;
+  updateCellSize(w);
+  if (w.ws_col == width_ && w.ws_row == height_) return false;
+  width_ = w.ws_col;
+  height_ = w.ws_row;
+  return true;
+}
+
+std::string TtyTerminal::query(std::string_view request) {
+  write(std::string{request} + "\33[c");
+
+  // The reply to DA1 is ESC[?<attributes>c, and always comes last.
+  std::string reply;
+  auto answered = [&reply] {
+    for (auto start = reply.find("\33[?"); start != std::string::npos; start = reply.find("\33[?", start + 1)) {
+      auto end = reply.find_first_not_of("0123456789;", start + 3);
+      if (end != std::string::npos && reply[end] == 'c') return true;
+    }
+    return false;
+  };
+  while (!answered()) {
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    if (poll(&pfd, 1, QUERY_TIMEOUT_MS) <= 0) break;
+    char buf[64];
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n <= 0) break;
+    reply.append(buf, static_cast<std::size_t>(n));
+  }
+  return reply;
+}
+
+bool TtyTerminal::updateCellSize(const struct winsize &size) {
+  if (size.ws_xpixel == 0 || size.ws_ypixel == 0 || size.ws_col == 0 || size.ws_row == 0) return false;
+  cellPixelWidth_ = std::max(1u, static_cast<unsigned int>(size.ws_xpixel / size.ws_col));
+  cellPixelHeight_ = std::max(1u, static_cast<unsigned int>(size.ws_ypixel / size.ws_row));
+  return true;
+}
+
+TtyTerminal::~TtyTerminal() {
+  if (resizePipe_[0] != -1) {
+    sigaction(SIGWINCH, &previousResizeAction_, nullptr);
+    close(resizePipe_[0]);
+    close(resizePipe_[1]);
+    resizePipe_[0] = resizePipe_[1] = -1;
+  }
+  std::cout << std::flush;
+  restore();
+  for (std::size_t i = 0; i < std::size(FATAL_SIGNALS); ++i) {
+    sigaction(FATAL_SIGNALS[i], &previousFatalActions_[i], nullptr);
+  }
+}
+
+void TtyTerminal::write(std::string_view data) {
+  std::cout << std::flush;
+  while (!data.empty()) {
+    ssize_t n = ::write(STDOUT_FILENO, data.data(), size(data));
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+}
+
+int TtyTerminal::readKey() {
+  // Read unbuffered, so that no keys are held back in a stdio buffer while
+  // the caller polls fd().
+  unsigned char ch;
+  ssize_t n;
+  do {
+    n = read(STDIN_FILENO, &ch, 1);
+  } while (n == -1 && errno == EINTR);
+  return n == 1 ? ch : -1;
+}
+
+int TtyTerminal::fd() const {
+  return STDIN_FILENO;
+}
+
+HeadlessTerminal::HeadlessTerminal(unsigned int width, unsigned int height) :
+  width_ {width}, height_ {height}, pendingWidth_ {width}, pendingHeight_ {height} {}
+
+bool HeadlessTerminal::updateSize() {
+  if (pendingWidth_ == width_ && pendingHeight_ == height_) return false;
+  width_ = pendingWidth_;
+  height_ = pendingHeight_;
+  return true;
+}
+
+void HeadlessTerminal::resize(unsigned int width, unsigned int height) {
+  pendingWidth_ = width;
+  pendingHeight_ = height;
+}
+
+int HeadlessTerminal::readKey() {
+  if (keys_.empty()) {
+    return -1;
+  }
+  char ch = keys_.front();
+  keys_.pop_front();
+  return static_cast<unsigned char>(ch);
+}
+
+void HeadlessTerminal::queueKeys(const std::string &keys) {
+  keys_.insert(end(keys_), begin(keys), end(keys));
+}
+
+void HeadlessTerminal::clearOutput() {
+  output_.clear();
+}
+
+}  // namespace dcurses
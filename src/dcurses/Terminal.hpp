@@ -0,0 +1,247 @@
+// Copyright 2022 Daniel Liu
+
+// Terminal.hpp
+// Terminal backends that dcurses renders to and reads input from.
+
+#ifndef DCURSES_TERMINAL_HPP_
+#define DCURSES_TERMINAL_HPP_
+
+#include <deque>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+// How long to wait for the terminal to answer a query at startup.
+#define QUERY_TIMEOUT_MS 200
+
+// Size of a character cell in pixels, for terminals that do not report it.
+#define DEFAULT_CELL_PIXEL_WIDTH 8
+#define DEFAULT_CELL_PIXEL_HEIGHT 16
+
+namespace dcurses {
+
+/*
+ * Abstract terminal backend. All rendering output and keyboard input goes
+ * through a Terminal, so that dcurses can run against a real TTY or an
+ * in-memory terminal.
+ */
+class Terminal {
+ public:
+  virtual ~Terminal() = default;
+
+  /*
+   * Writes rendering output to the terminal. Each call is expected to be a whole frame (or a
+   * whole control sequence), and is sent with as few system calls as possible.
+   */
+  virtual void write(std::string_view data) = 0;
+
+  /*
+   * Reads a single key from the terminal, blocking until one is available.
+   * @return The key read, or -1 if no more input is available.
+   */
+  virtual int readKey() = 0;
+
+  /*
+   * Returns a file descriptor that becomes readable when a key is available,
+   * or -1 if input never blocks.
+   */
+  virtual int fd() const { return -1; }
+
+  /*
+   * Returns a file descriptor that becomes readable when the terminal is resized, or -1 if
+   * the terminal is never resized.
+   */
+  virtual int resizeFd() const { return -1; }
+
+  /*
+   * Re-reads the size of the terminal if it was resized since the last call.
+   * @return true if width() or height() changed.
+   */
+  virtual bool updateSize() { return false; }
+
+  /*
+   * Returns true if the terminal supports synchronized output (DEC private mode 2026), so that
+   * a frame wrapped in ESC[?2026h and ESC[?2026l is displayed as one atomic update.
+   */
+  virtual bool synchronizedOutput() const { return false; }
+
+  /*
+   * Returns true if the terminal supports the kitty graphics protocol, so that images can be
+   * uploaded once under an id and then placed by id.
+   */
+  virtual bool kittyGraphics() const { return false; }
+
+  /*
+   * Returns true if the terminal supports iTerm2 inline images.
+   */
+  virtual bool iterm2Images() const { return false; }
+
+  /*
+   * Returns the width of the terminal, in characters.
+   */
+  virtual unsigned int width() const = 0;
+
+  /*
+   * Returns the height of the terminal, in characters.
+   */
+  virtual unsigned int height() const = 0;
+
+  /*
+   * Returns the width of a character cell, in pixels.
+   */
+  virtual unsigned int cellPixelWidth() const { return DEFAULT_CELL_PIXEL_WIDTH; }
+
+  /*
+   * Returns the height of a character cell, in pixels.
+   */
+  virtual unsigned int cellPixelHeight() const { return DEFAULT_CELL_PIXEL_HEIGHT; }
+};
+
+/*
+ * Terminal backend for the controlling TTY. Switches the terminal into raw
+ * mode on the alternate screen for the lifetime of the object. The terminal is
+ * also restored if the process is killed by a signal.
+ */
+class TtyTerminal : public Terminal {
+ public:
+  /*
+   * Saves the terminal settings, enters raw mode on the alternate screen, starts listening for
+   * SIGWINCH, and asks the terminal which features it supports. Exits if standard input is not
+   * a terminal.
+   */
+  TtyTerminal();
+
+  /*
+   * Restores the terminal settings, the main screen and the previous signal handlers.
+   */
+  ~TtyTerminal() override;
+
+  TtyTerminal(const TtyTerminal &other) = delete;
+  TtyTerminal &operator=(const TtyTerminal &other) = delete;
+
+  void write(std::string_view data) override;
+  int readKey() override;
+  int fd() const override;
+  int resizeFd() const override { return resizePipe_[0]; }
+  bool updateSize() override;
+  bool synchronizedOutput() const override { return synchronizedOutput_; }
+  bool kittyGraphics() const override { return kittyGraphics_; }
+  bool iterm2Images() const override { return iterm2Images_; }
+  unsigned int width() const override { return width_; }
+  unsigned int height() const override { return height_; }
+  unsigned int cellPixelWidth() const override { return cellPixelWidth_; }
+  unsigned int cellPixelHeight() const override { return cellPixelHeight_; }
+
+ private:
+  /*
+   * Sends a query to the terminal, followed by a primary device attributes request, and returns
+   * everything the terminal replies up to the answer to the latter. Every terminal answers DA1,
+   * so terminals that ignore the query do not stall startup until the timeout.
+   */
+  std::string query(std::string_view request);
+
+  /*
+   * Reads the size of a character cell from the window size in pixels.
+   * @return false if the terminal does not report the size in pixels.
+   */
+  bool updateCellSize(const struct winsize &size);
+
+  /*
+   * Leaves raw mode and the alternate screen, if the terminal is still in them. Only makes
+   * async-signal-safe calls, so that it can run in a signal handler.
+   */
+  static void restore();
+
+  /*
+   * Handler for signals that terminate the process. Restores the terminal and then re-raises
+   * the signal, which now has its default action.
+   */
+  static void handleFatalSignal(int signal);
+
+  /*
+   * SIGWINCH handler. Writes a byte to the resize pipe, which is all that is safe to do in a
+   * signal handler; the size itself is read later by updateSize.
+   */
+  static void handleResizeSignal(int signal);
+
+  // Written to by the SIGWINCH handler, so there can only be one listening TtyTerminal.
+  static int resizePipe_[2];
+  struct sigaction previousResizeAction_;
+
+  // Signals whose default action terminates the process without a chance to run destructors.
+  static constexpr int FATAL_SIGNALS[] = {SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGABRT, SIGSEGV, SIGBUS, SIGFPE,
+                                          SIGILL};
+  struct sigaction previousFatalActions_[std::size(FATAL_SIGNALS)];
+
+  // The settings to restore, read by the signal handlers.
+  static struct termios savedTermios_;
+  static volatile sig_atomic_t raw_;
+
+  bool synchronizedOutput_ = false;
+  bool kittyGraphics_ = false;
+  bool iterm2Images_ = false;
+  unsigned int width_;
+  unsigned int height_;
+  unsigned int cellPixelWidth_ = DEFAULT_CELL_PIXEL_WIDTH;
+  unsigned int cellPixelHeight_ = DEFAULT_CELL_PIXEL_HEIGHT;
+};
+
+/*
+ * In-memory terminal backend with a fixed size. Output is captured in memory
+ * and input is read from a queue of keys, which makes it possible to drive
+ * dcurses without a TTY.
+ */
+class HeadlessTerminal : public Terminal {
+ public:
+  /*
+   * Constructs a headless terminal of the specified size.
+   */
+  HeadlessTerminal(unsigned int width, unsigned int height);
+
+  void write(std::string_view data) override { output_.append(data); }
+  int readKey() override;
+  bool updateSize() override;
+  unsigned int width() const override { return width_; }
+  unsigned int height() const override { return height_; }
+
+  /*
+   * Resizes the terminal. The new size is picked up by the next call to updateSize.
+   */
+  void resize(unsigned int width, unsigned int height);
+
+  /*
+   * Queues keys to be returned by readKey.
+   */
+  void queueKeys(const std::string &keys);
+
+  /*
+   * Returns everything written since the last call to clearOutput.
+   */
+  const std::string &output() const { return output_; }
+
+  /*
+   * Returns the number of bytes written since the last call to clearOutput.
+   */
+  std::size_t bytesWritten() const { return size(output_); }
+
+  /*
+   * Discards all captured output.
+   */
+  void clearOutput();
+
+ private:
+  unsigned int width_;
+  unsigned int height_;
+  unsigned int pendingWidth_;
+  unsigned int pendingHeight_;
+  std::string output_;
+  std::deque<char> keys_;
+};
+
+}  // namespace dcurses
+
+#endif
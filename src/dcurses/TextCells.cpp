@@ -0,0 +1,97 @@
+// Copyright 2022 Daniel Liu
+
+// TextCells.cpp
+
+#include "TextCells.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "CharWidth.hpp"
+#include "Style.hpp"
+
+namespace dcurses {
+
+uint32_t decodeUtf8(std::string_view text, std::size_t &length) {
+  auto lead = static_cast<unsigned char>(text[0]);
+  length = 1;
+  if (lead < 0x80) return lead;
+
+  uint32_t codePoint;
+  std::size_t expected;
+  if ((lead & 0xe0) == 0xc0) {
+    codePoint = lead & 0x1fu;
+    expected = 2;
+  } else if ((lead & 0xf0) == 0xe0) {
+    codePoint = lead & 0x0fu;
+    expected = 3;
+  } else if ((lead & 0xf8) == 0xf0) {
+    codePoint = lead & 0x07u;
+    expected = 4;
+  } else {
+    return 0xfffd;
+  }
+  if (size(text) < expected) return 0xfffd;
+  for (std::size_t i = 1; i < expected; ++i) {
+    auto byte = static_cast<unsigned char>(text[i]);
+    if ((byte & 0xc0) != 0x80) return 0xfffd;
+    codePoint = (codePoint << 6) | (byte & 0x3fu);
+  }
+  length = expected;
+  return codePoint;
+}
+
+void TextCells::Iterator::advance() {
+  while (!rest_.empty()) {
+    if (rest_[0] == '\33') {
+      std::size_t length = 2;
+      if (size(rest_) > 1 && rest_[1] == '[') {
+        // A CSI sequence ends at the first byte in the range @ to ~.
+        std::size_t end = 2;
+        while (end < size(rest_) && (rest_[end] < '@' || rest_[end] > '~')) ++end;
+        if (end < size(rest_) && rest_[end] == 'm') {
+          applySgr(cell_.style, rest_.substr(2, end - 2));
+        }
+        length = end + 1;
+      }
+      rest_.remove_prefix(std::min(length, size(rest_)));
+      continue;
+    }
+
+    std::size_t length;
+    cell_.width = charWidth(decodeUtf8(rest_, length));
+    // Zero-width code points that follow belong to the same cell.
+    std::size_t end = length;
+    while (end < size(rest_) && static_cast<unsigned char>(rest_[end]) >= 0x80) {
+      std::size_t next;
+      if (charWidth(decodeUtf8(rest_.substr(end), next)) != 0) break;
+      end += next;
+    }
+    cell_.text = rest_.substr(0, end);
+    rest_.remove_prefix(end);
+    return;
+  }
+  cell_.text = {};
+}
+
+unsigned int displayWidth(std::string_view text) {
+  unsigned int width = 0;
+  for (const TextCell &cell : TextCells{text}) {
+    width += cell.width;
+  }
+  return width;
+}
+
+std::string_view truncateToWidth(std::string_view text, unsigned int width) {
+  std::size_t end = 0;
+  for (const TextCell &cell : TextCells{text}) {
+    if (cell.width > width) break;
+    width -= cell.width;
+    end = static_cast<std::size_t>(cell.text.data() - text.data()) + size(cell.text);
+  }
+  return text.substr(0, end);
+}
+
+}  // namespace dcurses
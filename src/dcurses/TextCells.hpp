@@ -0,0 +1,113 @@
+// Copyright 2022 Daniel Liu
+
+// TextCells.hpp
+// Splitting styled UTF-8 text into terminal cells.
+
+#ifndef DCURSES_TEXT_CELLS_HPP_
+#define DCURSES_TEXT_CELLS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+#include "Style.hpp"
+
+namespace dcurses {
+
+/*
+ * Decodes the UTF-8 code point at the start of `text`, which must not be empty, and sets
+ * `length` to the number of bytes it takes up. A malformed or truncated sequence decodes as
+ * U+FFFD, one byte long.
+ */
+uint32_t decodeUtf8(std::string_view text, std::size_t &length);
+
+/*
+ * One cell of styled text.
+ */
+struct TextCell {
+  // The UTF-8 contents of the cell: a code point, followed by any zero-width code points
+  // (combining marks, joiners) that go with it. Points into the text being split.
+  std::string_view text;
+  // The style of the cell, from the SGR escape sequences before it.
+  Style style;
+  // The number of columns the cell takes up: 1, or 2 for a wide character. A zero-width code
+  // point with nothing to attach to is a cell of width 0.
+  unsigned int width;
+};
+
+/*
+ * Splits text into cells, as a range that can be iterated over without allocating:
+ *
+ *   for (const TextCell &cell : TextCells{text}) { ... }
+ *
+ * SGR escape sequences (ESC[...m) change the style of the cells after them, starting from
+ * `style`. Other escape sequences are skipped.
+ */
+class TextCells {
+ public:
+  class Iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = TextCell;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const TextCell *;
+    using reference = const TextCell &;
+
+    /*
+     * Constructs the end iterator.
+     */
+    Iterator() = default;
+
+    Iterator(std::string_view text, const Style &style) : rest_ {text} {
+      cell_.style = style;
+      advance();
+    }
+
+    const TextCell &operator*() const { return cell_; }
+    const TextCell *operator->() const { return &cell_; }
+
+    Iterator &operator++() {
+      advance();
+      return *this;
+    }
+
+    // Iterators are equal when they are at the same cell; the end iterator has no cell text.
+    bool operator==(const Iterator &other) const { return cell_.text.data() == other.cell_.text.data(); }
+    bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+   private:
+    /*
+     * Moves to the next cell, applying the escape sequences before it. At the end of the text,
+     * becomes equal to the end iterator.
+     */
+    void advance();
+
+    std::string_view rest_;
+    TextCell cell_ {};
+  };
+
+  explicit TextCells(std::string_view text, const Style &style = Style{}) : text_ {text}, style_ {style} {}
+
+  Iterator begin() const { return Iterator{text_, style_}; }
+  Iterator end() const { return Iterator{}; }
+
+ private:
+  std::string_view text_;
+  Style style_;
+};
+
+/*
+ * Returns the number of columns the text takes up, ignoring escape sequences.
+ */
+unsigned int displayWidth(std::string_view text);
+
+/*
+ * Returns the longest prefix of the text that takes up at most `width` columns. Escape
+ * sequences after the last cell that fits are cut off with it.
+ */
+std::string_view truncateToWidth(std::string_view text, unsigned int width);
+
+}  // namespace dcurses
+
+#endif
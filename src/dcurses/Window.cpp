@@ -4,138 +4,92 @@
 
 #include "Window.hpp"
 
-#include <iostream>
+#include <algorithm>
 #include <memory>
 #include <optional>
 #include <string>
-#include <variant>
+#include <string_view>
 #include <vector>
 
-#include "Base64.hpp"
+#include "CellGrid.hpp"
 #include "Logging.hpp"
-#include "dvim/Utilities.hpp"
-
-#define ESC "\33"
+#include "Style.hpp"
+#include "TextCells.hpp"
 
 namespace dcurses {
 
 Window::Window(
-  unsigned int row, unsigned int col, unsigned int width, unsigned int height, 
+  unsigned int row, unsigned int col, unsigned int width, unsigned int height,
   int zIndex, const WindowBorder &border) :
-  row_ {row}, col_ {col}, width_ {width}, height_ {height}, zIndex_ {zIndex}, 
-  border_ {border}, cache_ {height, {width, " "}} {
+  row_ {row}, col_ {col}, width_ {width}, height_ {height}, zIndex_ {zIndex},
+  border_ {border}, content_ {width, height} {
   clear();
 }
 
 void Window::setCharacter(unsigned int row, unsigned int col, char character) {
-  directions_.emplace_back(RenderDirection{ row, col, character });
+  directions_.push_back(RenderDirection{ row, col, size(text_), 1 });
+  text_ += character;
 }
 
-void Window::setString(unsigned int row, unsigned int col, const std::string& string) {
-  directions_.emplace_back(RenderDirection{ row, col, string });
+void Window::setString(unsigned int row, unsigned int col, std::string_view string) {
+  directions_.push_back(RenderDirection{ row, col, size(text_), size(string) });
+  text_ += string;
 }
 
 void Window::drawImage(const ImageContent &image) {
-  if (iterm2_ == 1) {
-    directions_.emplace_back(RenderDirection{ image.row_, image.col_, image });
-    hasImages_ = true;
+  // The kitty graphics protocol only takes PNG files as they are.
+  bool shown = kitty_ == 1 ? image.content_->format == ImageFormat::PNG : iterm2_ == 1;
+  if (shown) {
+    images_.push_back(image);
   } else {
-    directions_.emplace_back(RenderDirection{ image.row_, image.col_, std::string{ "Image content." }});
+    setString(image.row_, image.col_, "Image content.");
   }
 }
 
-void Window::refresh() {
-  if (hasImages_) {
-    // purge the window and cache
-    std::cout << ESC << "[0m";
-    for (unsigned int r = 0; r < height_; ++r) {
-      unsigned int line = row_ + r + 1;
-      unsigned int col = col_ + 1;
-      std::cout << ESC << "[" << line << ";" << col << "f";
-      std::cout << std::string(width_, ' ');
-      for (unsigned int c = 0; c < width_; ++c) {
-        cache_[r][c] = " ";
+void Window::render() {
+  content_.fill();
+  for (const auto &direction : directions_) {
+    unsigned int row = direction.row;
+    unsigned int col = direction.col;
+    if (row >= height_) continue;
+
+    // Split the string into cells. SGR escape sequences change the style of the following
+    // cells; other escape sequences are dropped. A wide character takes up its cell and a
+    // continuation cell, or a blank if only one column is left.
+    std::string_view text {text_.data() + direction.offset, direction.length};
+    Style style;
+    uint16_t attribute = 0;
+    for (const TextCell &cell : TextCells{text}) {
+      if (col >= width_) break;
+      if (cell.width == 0) continue;
+      if (cell.style != style) {
+        style = cell.style;
+        attribute = CellGrid::internStyle(style);
       }
-    }
-
-    for (const auto &direction : directions_) {
-      unsigned int row = direction.row;
-      unsigned int col = direction.col;
-      unsigned int line = row_ + row + 1;
-      unsigned int column = col_ + col + 1;
-      std::cout << ESC << "[" << line << ";" << column << "f";
-      if (std::holds_alternative<char>(direction.content)) {
-        const auto &character = std::get<char>(direction.content);
-        std::cout << character;
-      } else if (std::holds_alternative<std::string>(direction.content)) {
-        const auto &string = std::get<std::string>(direction.content);
-        std::cout << string;
+      if (cell.width == 2 && col + 1 < width_) {
+        content_.set(row, col, cell.text, attribute);
+        content_.fillRect(row, col + 1, row + 1, col + 2, CellGrid::CONTINUATION_GLYPH, attribute);
+        col += 2;
       } else {
-        const auto &image = std::get<ImageContent>(direction.content);
-        if (getTmux() == 1) {
-          std::cout << "\033Ptmux;\033\033]";
-        } else {
-          std::cout << "\033]";
-        }
-        std::cout << "1337;File=inline=1;size=" << size(image.content_);
-        std::cout << ";width=" << image.width_ << ";height=" << image.height_;
-        std::cout << ":" << dcurses::base64Encode(image.content_);
-        if (getTmux() == 1) {
-          std::cout << "\a\033\\";
-        } else {
-          std::cout << "\a";
-        }
-      }
-    }
-    std::cout << std::flush;
-  } else {
-    // text only, use cache
-    std::vector<std::vector<std::string>> newContent {height_, {width_, " "}};
-    for (const auto &direction : directions_) {
-      unsigned int row = direction.row;
-      unsigned int col = direction.col;
-      if (std::holds_alternative<char>(direction.content)) {
-        const auto &character = std::get<char>(direction.content);
-        newContent[row][col] = std::string{character};
-      } else if (std::holds_alternative<std::string>(direction.content)) {
-        const auto &string = std::get<std::string>(direction.content);
-        for (auto character : dvim::splitVisibleCharacters(string)) {
-          newContent[row][col++] = character;
-        }
-      }
-    }
-
-    for (unsigned int r = 0; r < height_; ++r) {
-      for (unsigned int c = 0; c < width_; ++c) {
-        if (newContent[r][c] != cache_[r][c]) {
-          unsigned int line = row_ + r + 1;
-          unsigned int col = col_ + c + 1;
-          std::cout << ESC << "[" << line << ";" << col << "f";
-          std::cout << newContent[r][c];
-          cache_[r][c] = newContent[r][c];
-        }
+        content_.set(row, col++, cell.width == 2 ? " " : cell.text, attribute);
       }
     }
-    std::cout << std::flush;
   }
 }
 
+void Window::setGeometry(unsigned int row, unsigned int col, unsigned int width, unsigned int height) {
+  row_ = row;
+  col_ = col;
+  width_ = width;
+  height_ = height;
+  content_.resize(width, height);
+  clear();
+}
+
 void Window::clear() {
   directions_.clear();
-  if (hasImages_) {
-    // purge the window and cache
-    std::cout << ESC << "[0m";
-    for (unsigned int r = 0; r < height_; ++r) {
-      unsigned int line = row_ + r + 1;
-      unsigned int col = col_ + 1;
-      std::cout << ESC << "[" << line << ";" << col << "f";
-      std::cout << std::string(width_, ' ');
-      for (unsigned int c = 0; c < width_; ++c) {
-        cache_[r][c] = "";
-      }
-    }
-  }
-  hasImages_ = false;
+  text_.clear();
+  images_.clear();
 
   for (unsigned int i = 0; i < width_; ++i) {
     setString(0, i, border_.top_);
@@ -151,18 +105,8 @@ void Window::clear() {
   setString(height_ - 1, width_ - 1, border_.bottom_right_);
 }
 
-void Window::clearCache() {
-  std::cout << ESC << "[0m";
-  for (unsigned int r = 0; r < height_; ++r) {
-    unsigned int line = row_ + r + 1;
-    unsigned int col = col_ + 1;
-    std::cout << ESC << "[" << line << ";" << col << "H";
-    std::cout << std::string(width_, ' ');
-  }
-  cache_ = std::vector<std::vector<std::string>>(height_, {width_, ""});
-}
-
 int Window::iterm2_ = -1;
 int Window::tmux_ = -1;
+int Window::kitty_ = -1;
 
 }  // namespace dcurses
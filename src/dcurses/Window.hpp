@@ -9,9 +9,11 @@
 #include <memory>
 #include <optional>
 #include <string>
-#include <variant>
 #include <vector>
 
+#include "CellGrid.hpp"
+#include "ImageCache.hpp"
+
 #define NO_BORDER {" "," "," "," "," "," "," "," "}
 #ifdef ASCIIONLY
 #define DEFAULT_BORDER {"+","-","+","|","+","-","+","|"}
@@ -43,14 +45,15 @@ class Window {
   };
 
   /*
-   * A POD struct containing all the details of an image.
+   * A POD struct containing all the details of an image. The encoded contents are shared, so
+   * that an image is only sent to the terminal again when its contents or placement change.
    */
   struct ImageContent {
     unsigned int row_;
     unsigned int col_;
     unsigned int width_;
     unsigned int height_;
-    std::string content_;
+    std::shared_ptr<const CachedImage> content_;
   };
 
   /*
@@ -60,7 +63,7 @@ class Window {
    * @param border The border characters, in the following order: top-left, top, top-right, right, bottom-right, bottom, bottom-left, left.
    */
   Window(
-    unsigned int row, unsigned int col, unsigned int width, unsigned int height, 
+    unsigned int row, unsigned int col, unsigned int width, unsigned int height,
     int zIndex, const WindowBorder &border = DEFAULT_BORDER);
 
   /*
@@ -79,7 +82,7 @@ class Window {
    * @param col The column of the top left corner of the string.
    * @param character The string to set.
    */
-  void setString(unsigned int row, unsigned int col, const std::string& string);
+  void setString(unsigned int row, unsigned int col, std::string_view string);
 
   /*
    * Renders an image at the specified position. The contents and sizing of the image are specified by the ImageContent struct passed in.
@@ -89,9 +92,20 @@ class Window {
   void drawImage(const ImageContent &image);
 
   /*
-   * Renders the window onto the screen, using `row_` and `col_` as the top left corner.
+   * Rasterizes the window's contents into its cell buffer. The window does not write to the
+   * terminal itself; the WindowManager composes the cell buffers of all windows into one frame.
+   */
+  void render();
+
+  /*
+   * Get the rendered cells of the window. Only valid after render().
    */
-  void refresh();
+  const CellGrid &cells() const { return content_; }
+
+  /*
+   * Get the images drawn in the window since the last clear().
+   */
+  const std::vector<ImageContent> &images() const { return images_; }
 
   /*
    * Clears the window, removing all contents.
@@ -99,9 +113,10 @@ class Window {
   void clear();
 
   /*
-   * Clears the rendering cache.
+   * Moves and resizes the window, and clears it. The cell buffer is only reallocated if the
+   * size changed.
    */
-  void clearCache();
+  void setGeometry(unsigned int row, unsigned int col, unsigned int width, unsigned int height);
 
   /*
    * Get the row of the window's top left corner.
@@ -142,6 +157,13 @@ class Window {
     if (tmux_ == -1) tmux_ = tmux;
   }
 
+  /*
+   * Set kitty graphics protocol status.
+   */
+  static void setKitty(int kitty) {
+    if (kitty_ == -1) kitty_ = kitty;
+  }
+
   /*
    * Get iterm2 status.
    */
@@ -152,13 +174,24 @@ class Window {
    */
   static int getTmux() { return tmux_; }
 
+  /*
+   * Get kitty graphics protocol status.
+   */
+  static int getKitty() { return kitty_; }
+
  private:
+  /*
+   * A string drawn at a position. The string is stored in text_, at [offset, offset + length).
+   */
   struct RenderDirection {
     unsigned int row;
     unsigned int col;
-    std::variant<char, std::string, ImageContent> content;
+    std::size_t offset;
+    std::size_t length;
   };
   std::vector<RenderDirection> directions_;
+  std::string text_;
+  std::vector<ImageContent> images_;
 
   unsigned int row_;
   unsigned int col_;
@@ -167,14 +200,14 @@ class Window {
   int zIndex_;
   WindowBorder border_;
 
-  bool hasImages_ = false;
-  std::vector<std::vector<std::string>> cache_;
+  CellGrid content_;
 
   // -1 = unsure
   // 0 = not iterm2
   // 1 = iterm2
   static int iterm2_;
   static int tmux_;
+  static int kitty_;
 };
 
 }  // namespace dcurses
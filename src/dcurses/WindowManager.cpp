@@ -5,91 +5,530 @@
 #include "WindowManager.hpp"
 
 #include <algorithm>
-#include <iostream>
-#include <map>
+#include <chrono>
+#include <cstdint>
 #include <memory>
-#include <queue>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
-#include <sys/ioctl.h>
-#include <unistd.h>
-
 #include "Logging.hpp"
+#include "Terminal.hpp"
 
 #define ESC "\33"
 
 namespace dcurses {
 
-WindowManager::WindowManager() {
-  struct winsize w;
-  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-  screenWidth_ = w.ws_col;
-  screenHeight_ = w.ws_row;
+namespace {
+
+double microsecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+WindowManager::WindowManager(Terminal &terminal) :
+  terminal_ {terminal}, screenWidth_ {terminal.width()}, screenHeight_ {terminal.height()},
+  covered_(static_cast<std::size_t>(screenWidth_) * screenHeight_, 0),
+  lastFrame_ {screenWidth_, screenHeight_}, scrolled_ {screenWidth_, screenHeight_},
+  frameHashes_(screenHeight_), lastFrameHashes_(screenHeight_) {
+  composed_.cells.resize(screenWidth_, screenHeight_);
 }
 
 WindowManager::~WindowManager() {
+  stopRenderThread();
 }
 
-void WindowManager::addWindow(const std::string &name, const WindowSettings &settings) {
-  LOG("Added window: " + name + " with width: " + std::to_string(settings.width) + " and height: " + std::to_string(settings.height));
-  std::shared_ptr<Window> window = std::make_shared<Window>(
-    settings.row, settings.col, settings.width, settings.height, settings.zIndex, settings.border);
-  windows_[nextId_] = window;
-  windowsByName_[name] = nextId_;
-  for (auto &[id, window] : windows_) {
-    window->clearCache();
+WindowHandle WindowManager::addWindow(const WindowSettings &settings) {
+  LOG("Added window with width: " + std::to_string(settings.width) + " and height: " + std::to_string(settings.height));
+  uint32_t index;
+  if (!freeSlots_.empty()) {
+    index = freeSlots_.back();
+    freeSlots_.pop_back();
+  } else {
+    index = static_cast<uint32_t>(size(slots_));
+    slots_.emplace_back();
   }
-  ++nextId_;
+  Slot &slot = slots_[index];
+  slot.settings = settings;
+  slot.window.emplace(
+    settings.row.resolve(screenHeight_), settings.col.resolve(screenWidth_),
+    std::max(settings.width.resolve(screenWidth_), 1u), std::max(settings.height.resolve(screenHeight_), 1u),
+    settings.zIndex, settings.border);
+  slot.sequence = nextSequence_++;
+  sortWindows();
+  return {index, slot.generation};
 }
 
-void WindowManager::removeWindow(const std::string &name) {
-  windows_.erase(windowsByName_[name]);
-  windowsByName_.erase(name);
-  for (auto &[id, window] : windows_) {
-    window->clearCache();
+void WindowManager::removeWindow(WindowHandle handle) {
+  if (!contains(handle)) return;
+  Slot &slot = slots_[handle.index];
+  slot.window.reset();
+  ++slot.generation;
+  freeSlots_.push_back(handle.index);
+  sortWindows();
+}
+
+Window &WindowManager::operator[](WindowHandle handle) {
+  if (!contains(handle)) {
+    throw std::out_of_range("stale window handle");
   }
-  std::cout << ESC << "[2J" << std::flush;
+  return *slots_[handle.index].window;
 }
 
-std::shared_ptr<Window> WindowManager::operator[](const std::string &name) {
-  auto it = windowsByName_.find(name);
-  if (it != windowsByName_.end()) {
-    return windows_[it->second];
+WindowManager::WindowSettings WindowManager::settings(WindowHandle handle) const {
+  if (!contains(handle)) {
+    throw std::out_of_range("stale window handle");
   }
-  return {};
+  return slots_[handle.index].settings;
+}
+
+bool WindowManager::updateSize() {
+  if (!terminal_.updateSize()) return false;
+  screenWidth_ = terminal_.width();
+  screenHeight_ = terminal_.height();
+  LOG("Resized to " + std::to_string(screenWidth_) + "x" + std::to_string(screenHeight_));
+
+  // The renderer's buffers follow the size of the frames it is given.
+  covered_.resize(static_cast<std::size_t>(screenWidth_) * screenHeight_);
+  invalidate();
+
+  for (uint32_t index : zOrder_) {
+    const WindowSettings &settings = slots_[index].settings;
+    slots_[index].window->setGeometry(
+      settings.row.resolve(screenHeight_), settings.col.resolve(screenWidth_),
+      std::max(settings.width.resolve(screenWidth_), 1u), std::max(settings.height.resolve(screenHeight_), 1u));
+  }
+  return true;
+}
+
+void WindowManager::sortWindows() {
+  // Topmost first. Windows with equal z-indices are stacked in the order they were added.
+  zOrder_.clear();
+  for (uint32_t i = 0; i < size(slots_); ++i) {
+    if (slots_[i].window) zOrder_.push_back(i);
+  }
+  std::sort(begin(zOrder_), end(zOrder_), [this](uint32_t a, uint32_t b) {
+    int zA = slots_[a].window->zIndex();
+    int zB = slots_[b].window->zIndex();
+    return zA != zB ? zA > zB : slots_[a].sequence > slots_[b].sequence;
+  });
+}
+
+void WindowManager::invalidate() {
+  composed_.repaint = true;
+}
+
+void WindowManager::beginFrame() {
+  frameStart_ = std::chrono::steady_clock::now();
+  frameStartAllocations_ = allocationCount();
 }
 
 void WindowManager::refresh() {
-  auto comp = [&](auto window1, auto window2) {
-    return windows_[window1]->zIndex() > windows_[window2]->zIndex();
-  };
+  auto composeStart = std::chrono::steady_clock::now();
+  compose();
+  FrameSample &sample = composed_.sample;
+  sample = FrameSample{};
+  sample.composeMicros = microsecondsSince(composeStart);
+  if (frameStart_) {
+    sample.viewMicros = std::chrono::duration<double, std::micro>(composeStart - *frameStart_).count();
+    sample.allocations = allocationCount() - frameStartAllocations_;
+    frameStart_.reset();
+  }
+  if (!renderThread_.joinable()) {
+    present(composed_);
+    return;
+  }
+
+  // Hand the frame to the render thread, replacing any frame it has not started on yet.
+  {
+    std::lock_guard<std::mutex> lock {mutex_};
+    bool repaint = composed_.repaint || (framePending_ && pending_.repaint);
+    std::swap(composed_, pending_);
+    pending_.repaint = repaint;
+    composed_.repaint = false;
+    framePending_ = true;
+  }
+  frameReady_.notify_one();
+}
 
-  std::vector<int> ids ( size(windows_), 0 );
-  std::transform(windows_.begin(), windows_.end(), ids.begin(), [](auto it) { return it.first; });
+void WindowManager::startRenderThread() {
+  if (renderThread_.joinable()) return;
+  stopping_ = false;
+  renderThread_ = std::thread {&WindowManager::renderLoop, this};
+}
 
-  // Sort windows by zIndex.
-  std::priority_queue<int, std::vector<int>, decltype(comp)> windowQueue{begin(ids), end(ids), comp};
+void WindowManager::stopRenderThread() {
+  if (!renderThread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock {mutex_};
+    stopping_ = true;
+  }
+  frameReady_.notify_one();
+  renderThread_.join();
+}
 
-  // system("clear");
-  
-  // std::cout << ESC << "[2J" << std::flush;
-  std::cout << ESC << "[3J";
+void WindowManager::renderLoop() {
+  const auto frameInterval = std::chrono::microseconds {1000000 / FRAME_RATE};
+  std::unique_lock<std::mutex> lock {mutex_};
+  while (true) {
+    frameReady_.wait(lock, [this] { return framePending_ || stopping_; });
+    if (stopping_) break;
+    std::swap(pending_, rendered_);
+    framePending_ = false;
+    lock.unlock();
 
-  // ESC[H move cursor to top left.
-  std::cout << ESC << "[H";
+    auto frameStart = std::chrono::steady_clock::now();
+    present(rendered_);
+
+    // Frames refreshed before the next one is due are coalesced into it.
+    lock.lock();
+    frameReady_.wait_until(lock, frameStart + frameInterval, [this] { return stopping_; });
+  }
+}
+
+void WindowManager::compose() {
+  std::fill(begin(covered_), end(covered_), 0);
+  CellGrid &frame = composed_.cells;
+  frame.resize(screenWidth_, screenHeight_);
+  composed_.windows.clear();
+  composed_.images.clear();
+  uint32_t *glyphs = frame.glyphs();
+  uint16_t *attributes = frame.attributes();
+  for (uint32_t index : zOrder_) {
+    Window *window = &*slots_[index].window;
+    LOG("Composing window at " + std::to_string(window->row()) + ":" + std::to_string(window->col()));
+    window->render();
+    unsigned int rowEnd = std::min(window->row() + window->height(), screenHeight_);
+    unsigned int colEnd = std::min(window->col() + window->width(), screenWidth_);
+    if (window->row() < rowEnd && window->col() < colEnd) {
+      composed_.windows.push_back({window->row(), window->col(), rowEnd, colEnd});
+    }
+
+    // Images are drawn over the composed text, so only draw the ones that no higher window covers.
+    std::size_t firstImage = size(composed_.images);
+    for (const auto &image : window->images()) {
+      unsigned int top = window->row() + image.row_;
+      unsigned int left = window->col() + image.col_;
+      unsigned int bottom = std::min(top + image.height_, rowEnd);
+      unsigned int right = std::min(left + image.width_, colEnd);
+      bool visible = top < bottom && left < right;
+      for (unsigned int r = top; r < bottom && visible; ++r) {
+        for (unsigned int c = left; c < right; ++c) {
+          if (covered_[frame.index(r, c)]) {
+            visible = false;
+            break;
+          }
+        }
+      }
+      if (visible) {
+        composed_.images.push_back({top, left, bottom, right, image});
+      }
+    }
+
+    const CellGrid &cells = window->cells();
+    for (unsigned int r = window->row(); r < rowEnd; ++r) {
+      std::size_t target = frame.index(r, 0);
+      std::size_t source = cells.index(r - window->row(), 0);
+      for (unsigned int c = window->col(); c < colEnd; ++c) {
+        if (!covered_[target + c]) {
+          covered_[target + c] = 1;
+          glyphs[target + c] = cells.glyphs()[source + c - window->col()];
+          attributes[target + c] = cells.attributes()[source + c - window->col()];
+        }
+      }
+    }
+
+    // Cells under an inline image are marked, so that an image that stays put is not sent
+    // again. Kitty images are drawn over the cells rather than replacing them, so the cells
+    // keep the window's contents.
+    for (std::size_t i = firstImage; i < size(composed_.images) && Window::getKitty() != 1; ++i) {
+      const auto &placement = composed_.images[i];
+      frame.fillRect(placement.row, placement.col, placement.bottom, placement.right, CellGrid::IMAGE_GLYPH);
+    }
+  }
+
+  // Cells that no window covers are blank.
+  for (std::size_t i = 0; i < size(covered_); ++i) {
+    if (!covered_[i]) {
+      glyphs[i] = ' ';
+      attributes[i] = 0;
+    }
+  }
+
+  // A wide character must be followed by its continuation cell. Where a window covers one half
+  // of a wide character in a window below it, the other half is shown as a blank.
+  for (unsigned int r = 0; r < screenHeight_; ++r) {
+    uint32_t *row = glyphs + frame.index(r, 0);
+    for (unsigned int c = 0; c < screenWidth_; ++c) {
+      if (row[c] == CellGrid::CONTINUATION_GLYPH) {
+        if (c == 0 || CellGrid::glyphWidth(row[c - 1]) != 2) row[c] = ' ';
+      } else if (row[c] >= 0x1100 && CellGrid::glyphWidth(row[c]) == 2 &&
+                 (c + 1 == screenWidth_ || row[c + 1] != CellGrid::CONTINUATION_GLYPH)) {
+        row[c] = ' ';
+      }
+    }
+  }
+}
+
+void WindowManager::scrollWindows(const Frame &frame) {
+  // The terminal scrolls images along with the text, which the last frame cannot represent.
+  if (!frame.images.empty()) return;
+
+  const CellGrid &cells = frame.cells;
+  for (const Region &region : frame.windows) {
+    unsigned int top = region.top;
+    unsigned int bottom = region.bottom - 1;
+    unsigned int left = region.left;
+    unsigned int right = region.right;
+    if (bottom < top + 3) continue;
+
+    unsigned int changed = 0;
+    for (unsigned int r = top; r <= bottom; ++r) {
+      frameHashes_[r] = cells.hashRow(r, left, right);
+      lastFrameHashes_[r] = lastFrame_.hashRow(r, left, right);
+      changed += frameHashes_[r] != lastFrameHashes_[r];
+    }
+    if (changed < 2) continue;
+
+    // Find the shift with the longest run of rows that match the last frame. A positive shift
+    // means the contents moved up.
+    int bestShift = 0;
+    unsigned int bestStart = 0;
+    unsigned int bestLength = 0;
+    int span = static_cast<int>(bottom - top);
+    for (int shift = -span + 1; shift < span; ++shift) {
+      if (shift == 0) continue;
+      unsigned int length = 0;
+      for (unsigned int r = top; r <= bottom; ++r) {
+        int source = static_cast<int>(r) + shift;
+        if (source >= static_cast<int>(top) && source <= static_cast<int>(bottom) &&
+            frameHashes_[r] == lastFrameHashes_[static_cast<unsigned int>(source)]) {
+          ++length;
+          if (length > bestLength) {
+            bestShift = shift;
+            bestStart = r + 1 - length;
+            bestLength = length;
+          }
+        } else {
+          length = 0;
+        }
+      }
+    }
+    if (bestLength < 2) continue;
+
+    // The scroll region covers the matching rows and the rows they came from.
+    unsigned int regionTop = bestShift > 0 ? bestStart : bestStart - static_cast<unsigned int>(-bestShift);
+    unsigned int regionBottom = bestShift > 0 ?
+      bestStart + bestLength - 1 + static_cast<unsigned int>(bestShift) : bestStart + bestLength - 1;
+
+    // Scroll regions span the whole screen width, so compare the cost over whole rows,
+    // including any other windows that share them.
+    scrolled_ = lastFrame_;
+    scrolled_.scroll(regionTop, regionBottom, bestShift);
+    std::size_t from = cells.index(regionTop, 0);
+    std::size_t to = cells.index(regionBottom + 1, 0);
+    std::size_t repaintCost = cells.countDifferences(lastFrame_, from, to);
+    std::size_t scrollCost = cells.countDifferences(scrolled_, from, to) + 16;
+    if (scrollCost < repaintCost) {
+      LOG("Scrolling rows " + std::to_string(regionTop) + "-" + std::to_string(regionBottom) + " by " + std::to_string(bestShift));
+      encoder_.scroll(regionTop, regionBottom, bestShift);
+      std::swap(lastFrame_, scrolled_);
+    }
+  }
+}
+
+void WindowManager::present(Frame &frame) {
+  auto diffStart = std::chrono::steady_clock::now();
+  const CellGrid &cells = frame.cells;
+  unsigned int screenWidth = cells.width();
+  unsigned int screenHeight = cells.height();
+  if (lastFrame_.width() != screenWidth || lastFrame_.height() != screenHeight) {
+    lastFrame_.resize(screenWidth, screenHeight);
+    scrolled_.resize(screenWidth, screenHeight);
+    frameHashes_.resize(screenHeight);
+    lastFrameHashes_.resize(screenHeight);
+    frame.repaint = true;
+  }
+  bool repaint = frame.repaint;
+  if (frame.repaint) {
+    lastFrame_.fill(CellGrid::INVALID_GLYPH);
+    // The cursor may have moved too, for example when the terminal was resized.
+    encoder_.invalidateCursor();
+    frame.repaint = false;
+  }
+
+  encoder_.begin(screenWidth);
+
+  // Begin synchronized update: the terminal holds the frame until it is complete.
+  if (terminal_.synchronizedOutput()) encoder_.append(ESC "[?2026h");
+  encoder_.append(ESC "[3J");
 
   // Hide cursor.
-  std::cout << ESC << "[?25l";
+  encoder_.append(ESC "[?25l");
 
-  // Draw windows.
-  while (!windowQueue.empty()) {
-    LOG("Drawing window: " + std::to_string(windowQueue.top()));
-    std::shared_ptr<Window> window = windows_[windowQueue.top()];
-    window->refresh();
-    windowQueue.pop();
+  scrollWindows(frame);
+
+  // An image is sent again only if it is new, has moved, or some of its cells were overwritten
+  // (or lost, on a repaint) since it was sent. Writing to the cells under a kitty image does
+  // not remove it.
+  imagesToSend_.clear();
+  for (const auto &placement : frame.images) {
+    bool shown = std::find(begin(sentImages_), end(sentImages_), placement) != end(sentImages_) &&
+      (Window::getKitty() == 1 ? !repaint :
+        lastFrame_.rectIs(placement.row, placement.col, placement.bottom, placement.right, CellGrid::IMAGE_GLYPH));
+    imagesToSend_.push_back(!shown);
+  }
+
+  uint32_t *lastGlyphs = lastFrame_.glyphs();
+  uint16_t *lastAttributes = lastFrame_.attributes();
+  for (unsigned int r = 0; r < screenHeight; ++r) {
+    std::size_t rowStart = cells.index(r, 0);
+    std::size_t rowEnd = cells.index(r + 1, 0);
+    for (std::size_t i = cells.nextDifference(lastFrame_, rowStart, rowEnd); i < rowEnd;
+         i = cells.nextDifference(lastFrame_, i + 1, rowEnd)) {
+      uint32_t glyph = cells.glyphs()[i];
+      uint16_t attribute = cells.attributes()[i];
+      lastGlyphs[i] = glyph;
+      lastAttributes[i] = attribute;
+      ++frame.sample.cellsChanged;
+      // The right half of a wide character was written along with the left half, which always
+      // changes with it.
+      if (glyph == CellGrid::CONTINUATION_GLYPH) continue;
+      encoder_.moveTo(r, static_cast<unsigned int>(i - rowStart));
+      encoder_.setStyle(CellGrid::style(attribute));
+      cellText_.clear();
+      cells.appendText(cellText_, i);
+      encoder_.put(cellText_, CellGrid::glyphWidth(glyph));
+    }
   }
+
+  // Leave the terminal in the default style between frames.
+  encoder_.setStyle(Style{});
+
+  // The terminal draws images over the text. The cells inline images cover are already marked
+  // with IMAGE_GLYPH in lastFrame_, since the diff above copied them from the frame.
+  if (Window::getKitty() == 1) {
+    placeKittyImages(frame);
+  } else {
+    sendInlineImages(frame);
+  }
+  sentImages_ = frame.images;
+
+  // End synchronized update.
+  if (terminal_.synchronizedOutput()) encoder_.append(ESC "[?2026l");
+  frame.sample.diffMicros = microsecondsSince(diffStart);
+  auto writeStart = std::chrono::steady_clock::now();
+  terminal_.write(encoder_.data());
+  frame.sample.writeMicros = microsecondsSince(writeStart);
+  frame.sample.bytesWritten = size(encoder_.data());
+  stats_.record(frame.sample);
+}
+
+void WindowManager::sendInlineImages(const Frame &frame) {
+  for (std::size_t i = 0; i < size(frame.images); ++i) {
+    if (!imagesToSend_[i]) continue;
+    const auto &placement = frame.images[i];
+    const auto &image = placement.image;
+    encoder_.moveTo(placement.row, placement.col);
+    if (Window::getTmux() == 1) {
+      encoder_.append("\033Ptmux;\033\033]");
+    } else {
+      encoder_.append("\033]");
+    }
+    encoder_.append("1337;File=inline=1;size=");
+    encoder_.appendNumber(static_cast<unsigned int>(size(image.content_->contents)));
+    encoder_.append(";width=");
+    encoder_.appendNumber(image.width_);
+    encoder_.append(";height=");
+    encoder_.appendNumber(image.height_);
+    encoder_.append(":");
+    encoder_.appendBase64(image.content_->contents);
+    if (Window::getTmux() == 1) {
+      encoder_.append("\a\033\\");
+    } else {
+      encoder_.append("\a");
+    }
+    encoder_.invalidateCursor();
+  }
+}
+
+void WindowManager::placeKittyImages(const Frame &frame) {
+  // Placement n of the frame has placement id n + 1, so a placement that is replaced by one of
+  // the same image is moved rather than deleted.
+  for (std::size_t i = 0; i < size(sentImages_); ++i) {
+    if (i < size(frame.images) && frame.images[i].image.content_ == sentImages_[i].image.content_) {
+      continue;
+    }
+    encoder_.append(ESC "_Ga=d,d=i,q=2,i=");
+    encoder_.appendNumber(sentKittyIds_[i]);
+    encoder_.append(",p=");
+    encoder_.appendNumber(static_cast<unsigned int>(i + 1));
+    encoder_.append(ESC "\\");
+  }
+
+  sentKittyIds_.clear();
+  for (std::size_t i = 0; i < size(frame.images); ++i) {
+    const auto &placement = frame.images[i];
+    unsigned int id = uploadKittyImage(placement.image.content_);
+    sentKittyIds_.push_back(id);
+    if (!imagesToSend_[i]) continue;
+    // C=1 leaves the cursor where it is.
+    encoder_.moveTo(placement.row, placement.col);
+    encoder_.append(ESC "_Ga=p,C=1,q=2,i=");
+    encoder_.appendNumber(id);
+    encoder_.append(",p=");
+    encoder_.appendNumber(static_cast<unsigned int>(i + 1));
+    encoder_.append(",c=");
+    encoder_.appendNumber(placement.image.width_);
+    encoder_.append(",r=");
+    encoder_.appendNumber(placement.image.height_);
+    encoder_.append(ESC "\\");
+  }
+}
+
+unsigned int WindowManager::uploadKittyImage(const std::shared_ptr<const CachedImage> &image) {
+  auto it = std::find_if(begin(kittyImages_), end(kittyImages_), [&image](const KittyImage &uploaded) {
+    return uploaded.image == image;
+  });
+  if (it != end(kittyImages_)) {
+    it->lastUsed = ++kittyClock_;
+    return it->id;
+  }
+
+  if (size(kittyImages_) >= KITTY_IMAGE_LIMIT) {
+    auto oldest = std::min_element(begin(kittyImages_), end(kittyImages_), [](const auto &a, const auto &b) {
+      return a.lastUsed < b.lastUsed;
+    });
+    // d=I also frees the image's data on the terminal.
+    encoder_.append(ESC "_Ga=d,d=I,q=2,i=");
+    encoder_.appendNumber(oldest->id);
+    encoder_.append(ESC "\\");
+    kittyImages_.erase(oldest);
+  }
+
+  // Uploaded in chunks, as the protocol requires; m=1 marks every chunk but the last.
+  unsigned int id = nextKittyId_++;
+  std::string_view contents = image->contents;
+  encoder_.append(ESC "_Ga=t,f=100,t=d,q=2,i=");
+  encoder_.appendNumber(id);
+  encoder_.append(",");
+  do {
+    std::string_view chunk = contents.substr(0, KITTY_CHUNK_SIZE);
+    contents.remove_prefix(size(chunk));
+    encoder_.append(contents.empty() ? "m=0;" : "m=1;");
+    encoder_.appendBase64(chunk);
+    encoder_.append(ESC "\\");
+    if (!contents.empty()) encoder_.append(ESC "_G");
+  } while (!contents.empty());
+
+  kittyImages_.push_back(KittyImage{image, id, ++kittyClock_});
+  return id;
 }
 
 }  // namespace dcurses
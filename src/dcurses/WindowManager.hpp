@@ -6,35 +6,105 @@
 #ifndef DCURSES_WINDOW_MANAGER_HPP_
 #define DCURSES_WINDOW_MANAGER_HPP_
 
-#include <map>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "CellGrid.hpp"
+#include "FrameEncoder.hpp"
+#include "FrameStats.hpp"
+#include "ImageCache.hpp"
+#include "Terminal.hpp"
 #include "Window.hpp"
 
+// Maximum number of frames per second written by the render thread.
+#define FRAME_RATE 60
+
+// Maximum number of images kept uploaded to a terminal using the kitty graphics protocol.
+#define KITTY_IMAGE_LIMIT 16
+
+// Maximum number of image bytes sent in one kitty graphics command. Encodes to 4096 bytes.
+#define KITTY_CHUNK_SIZE 3072
+
 namespace dcurses {
 
+/*
+ * A handle to a window owned by a WindowManager. Handles stay cheap to copy and to resolve, and
+ * a handle to a removed window is detected by its generation rather than dangling.
+ */
+struct WindowHandle {
+  uint32_t index = UINT32_MAX;
+  uint32_t generation = 0;
+};
+
+/*
+ * A window's position or size along one axis of the screen, as a layout constraint: either a
+ * fixed number of cells, or a number of cells relative to the screen's width or height (for
+ * example, Extent::fromEnd(-30) is 30 cells less than the screen size). Constraints are
+ * resolved again whenever the screen is resized.
+ */
+struct Extent {
+  constexpr Extent(int offset = 0) : offset {offset} {}
+
+  /*
+   * An extent `offset` cells from the end of the axis. `offset` is usually negative.
+   */
+  static constexpr Extent fromEnd(int offset) {
+    Extent extent {offset};
+    extent.relative = true;
+    return extent;
+  }
+
+  constexpr Extent operator+(int cells) const {
+    Extent extent = *this;
+    extent.offset += cells;
+    return extent;
+  }
+  constexpr Extent operator-(int cells) const { return *this + -cells; }
+
+  /*
+   * Returns the number of cells the extent spans on an axis of the specified size, clamped
+   * to [0, screenSize].
+   */
+  unsigned int resolve(unsigned int screenSize) const {
+    long long cells = offset + (relative ? static_cast<long long>(screenSize) : 0);
+    return static_cast<unsigned int>(std::clamp<long long>(cells, 0, screenSize));
+  }
+
+  int offset = 0;
+  bool relative = false;
+};
+
 /*
  * Class to manage and display multiple windows.
  */
 class WindowManager {
  public:
   /*
-   * A POD struct containing information about a window.
+   * A POD struct containing information about a window. The window's geometry is given as
+   * layout constraints, so windows follow the screen when it is resized.
    */
   struct WindowSettings {
-    unsigned int row;
-    unsigned int col;
-    unsigned int width;
-    unsigned int height;
+    Extent row;
+    Extent col;
+    Extent width;
+    Extent height;
     int zIndex;
     Window::WindowBorder border;
   };
 
   /*
-   * Construct a new WindowManager. Automatically detects screen width and height.
+   * Construct a new WindowManager rendering to the specified terminal.
+   * Screen width and height are taken from the terminal.
    */
-  WindowManager();
+  explicit WindowManager(Terminal &terminal);
 
   /*
    * Deleted copy and move constructors/assignment operators.
@@ -45,36 +115,92 @@ class WindowManager {
   WindowManager& operator=(const WindowManager&& other) = delete;
 
   /*
-   * Destructor. Does nothing.
+   * Destructor. Stops the render thread, if it is running.
    */
   ~WindowManager();
 
   /*
    * Adds a new window to the window manager.
    * Window parameters are set using the WindowSettings struct.
-   * @param name The name of the window.
+   * Nothing is repainted: the next refresh only sends the cells the new window changes.
    * @param settings The settings of the window.
+   * @return A handle to the new window.
+   */
+  WindowHandle addWindow(const WindowSettings &settings);
+
+  /*
+   * Remove a window from the window manager. The handle, and any copies of it, become stale.
+   * Nothing is repainted: the next refresh recomposes the region the window uncovered from the
+   * windows below it, and only sends the cells that change.
+   * @param handle The window to remove.
+   */
+  void removeWindow(WindowHandle handle);
+
+  /*
+   * Returns true if the handle refers to a window that has not been removed.
    */
-  void addWindow(const std::string &name, const WindowSettings &settings);
+  bool contains(WindowHandle handle) const {
+    return handle.index < size(slots_) && slots_[handle.index].generation == handle.generation &&
+      slots_[handle.index].window.has_value();
+  }
 
   /*
-   * Remove a window from the window manager.
-   * @param name The name of the window to remove.
+   * Accesses a window by handle. The reference is invalidated by the next addWindow.
+   * Throws std::out_of_range if the handle is stale.
+   * @param handle The window's handle.
    */
-  void removeWindow(const std::string &name);
+  Window &operator[](WindowHandle handle);
 
   /*
-   * Accesses a window by name.
-   * @param name The name of the window.
-   * @return A weak pointer to the window.
+   * Returns the settings a window was added with. Throws std::out_of_range if the handle is
+   * stale.
+   * @param handle The window's handle.
    */
-  std::shared_ptr<Window> operator[](const std::string &name);
+  WindowSettings settings(WindowHandle handle) const;
 
   /*
-   * Refreshes the window, displaying it on the terminal.
+   * Picks up a change in the terminal's size. Lays out every window again from its settings
+   * (reallocating only the windows whose size changed), and repaints the whole screen on the
+   * next frame, since the terminal's contents are unknown after a resize. Call before the
+   * windows' contents are drawn for the next frame.
+   * @return true if the screen was resized.
+   */
+  bool updateSize();
+
+  /*
+   * Marks the start of drawing the windows' contents for a frame. The time and allocations
+   * from here to the next refresh are recorded as the frame's view time.
+   */
+  void beginFrame();
+
+  /*
+   * Refreshes the screen. Windows are composed into a single screen-sized frame in z-order,
+   * and only the cells that differ from the last frame sent are written to the terminal.
+   *
+   * Without a render thread, the frame is written before refresh returns. With one, the
+   * composed frame is handed to the render thread, and refresh returns without waiting for
+   * the terminal.
    */
   void refresh();
 
+  /*
+   * Forgets the last frame sent, so that the next frame repaints the whole screen.
+   */
+  void invalidate();
+
+  /*
+   * Starts writing frames to the terminal on a dedicated thread, at most FRAME_RATE times a
+   * second. When frames are refreshed faster than the render thread writes them (for example,
+   * over a slow link), the intermediate frames are dropped, and the next frame written goes
+   * straight from the last frame the terminal received to the newest one.
+   */
+  void startRenderThread();
+
+  /*
+   * Stops the render thread. Frames that were not written yet are dropped.
+   */
+  void stopRenderThread();
+
   /*
    * Returns the height of the window.
    */
@@ -85,13 +211,169 @@ class WindowManager {
    */
   unsigned int getWidth() const { return screenWidth_; }
 
+  /*
+   * Returns the terminal that the windows are rendered to.
+   */
+  Terminal &terminal() { return terminal_; }
+
+  /*
+   * Returns the counters of the frames written to the terminal. Frames that the render thread
+   * skipped because a newer one was queued are never written, so they are not counted.
+   */
+  const FrameStats &stats() const { return stats_; }
+
  private:
+  Terminal &terminal_;
   unsigned int screenWidth_;
   unsigned int screenHeight_;
 
-  int nextId_ = 0;
-  std::map<int, std::shared_ptr<Window>> windows_;
-  std::map<std::string, int> windowsByName_; // name -> id
+  /*
+   * A slot in the dense window array. A slot's generation is bumped when its window is
+   * removed, so old handles to the slot stop resolving.
+   */
+  struct Slot {
+    std::optional<Window> window;
+    WindowSettings settings;
+    uint32_t generation = 0;
+    uint64_t sequence = 0;
+  };
+
+  /*
+   * Re-sorts zOrder_. Only called when windows are added or removed.
+   */
+  void sortWindows();
+
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> freeSlots_;
+  std::vector<uint32_t> zOrder_;  // Indices of live slots, topmost first.
+  uint64_t nextSequence_ = 0;
+
+  /*
+   * A window's image, placed at an absolute screen position. Its visible cells are rows
+   * [row, bottom) and columns [col, right). The frame keeps its own copy, since the window may
+   * be cleared while the frame is being written.
+   */
+  struct ImagePlacement {
+    unsigned int row;
+    unsigned int col;
+    unsigned int bottom;
+    unsigned int right;
+    Window::ImageContent image;
+
+    bool operator==(const ImagePlacement &other) const {
+      return row == other.row && col == other.col && bottom == other.bottom && right == other.right &&
+        image.width_ == other.image.width_ && image.height_ == other.image.height_ &&
+        image.content_ == other.image.content_;
+    }
+  };
+
+  /*
+   * The screen area of a window: rows [top, bottom) and columns [left, right).
+   */
+  struct Region {
+    unsigned int top;
+    unsigned int left;
+    unsigned int bottom;
+    unsigned int right;
+  };
+
+  /*
+   * A composed frame: an immutable snapshot of the screen, which can be written to the
+   * terminal while the windows are drawn for the next one.
+   */
+  struct Frame {
+    CellGrid cells {0, 0};
+    std::vector<Region> windows;  // Topmost first.
+    std::vector<ImagePlacement> images;
+    bool repaint = true;  // The terminal's contents are unknown.
+    FrameSample sample;
+  };
+
+  /*
+   * An image uploaded to the terminal with the kitty graphics protocol, and the id it is stored
+   * under.
+   */
+  struct KittyImage {
+    std::shared_ptr<const CachedImage> image;
+    unsigned int id;
+    uint64_t lastUsed;
+  };
+
+  /*
+   * Composes all windows into composed_, from the highest z-index down. Each screen cell takes
+   * the contents of the topmost window covering it, so overlapping cells are written once.
+   */
+  void compose();
+
+  /*
+   * Looks for windows whose contents moved vertically since the last frame, and scrolls them
+   * on the terminal with a scroll region when that is cheaper than repainting them. Updates
+   * lastFrame_ to match.
+   */
+  void scrollWindows(const Frame &frame);
+
+  /*
+   * Encodes the difference between the frame and lastFrame_, and writes it to the terminal
+   * with a single write. When the terminal supports it, the frame is wrapped in a synchronized
+   * update.
+   */
+  void present(Frame &frame);
+
+  /*
+   * Sends each image in the frame that needs sending inline, with the iTerm2 protocol. The
+   * terminal stores images in the cells they cover, so an image is sent in full every time.
+   */
+  void sendInlineImages(const Frame &frame);
+
+  /*
+   * Shows the frame's images with the kitty graphics protocol. Each image is uploaded once,
+   * after which showing it again only takes a placement command, and images that are no longer
+   * in the frame are deleted from the screen.
+   */
+  void placeKittyImages(const Frame &frame);
+
+  /*
+   * Returns the id of the image on the terminal, uploading it first if it is not there.
+   * Deletes the least recently used image when more than KITTY_IMAGE_LIMIT are uploaded.
+   */
+  unsigned int uploadKittyImage(const std::shared_ptr<const CachedImage> &image);
+
+  /*
+   * The render thread's loop: writes the newest pending frame, then waits out the rest of the
+   * frame interval.
+   */
+  void renderLoop();
+
+  // Owned by the thread calling refresh.
+  Frame composed_;
+  std::vector<char> covered_;
+  std::optional<std::chrono::steady_clock::time_point> frameStart_;
+  std::size_t frameStartAllocations_ = 0;
+
+  FrameStats stats_;
+
+  // Shared with the render thread, guarded by mutex_.
+  std::mutex mutex_;
+  std::condition_variable frameReady_;
+  Frame pending_;
+  bool framePending_ = false;
+  bool stopping_ = false;
+  std::thread renderThread_;
+
+  // Owned by the render thread while it runs.
+  Frame rendered_;
+  CellGrid lastFrame_;
+  CellGrid scrolled_;
+  std::vector<uint64_t> frameHashes_;
+  std::vector<uint64_t> lastFrameHashes_;
+  std::vector<ImagePlacement> sentImages_;  // The images the terminal is showing.
+  std::vector<char> imagesToSend_;
+  std::vector<KittyImage> kittyImages_;
+  std::vector<unsigned int> sentKittyIds_;  // The kitty image id of each of sentImages_.
+  unsigned int nextKittyId_ = 1;
+  uint64_t kittyClock_ = 0;
+  std::string cellText_;
+  FrameEncoder encoder_;
 };
 
 }  // namespace dcurses
@@ -0,0 +1,459 @@
+// Copyright 2022 Daniel Liu
+
+// Zlib.cpp
+
+#include "Zlib.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dcurses {
+
+namespace {
+
+// Codes up to this many bits long are decoded with a single table lookup.
+constexpr unsigned int FAST_BITS = 10;
+
+// Base lengths and extra bits of length symbols 257-285.
+constexpr uint16_t LENGTH_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+  131, 163, 195, 227, 258};
+constexpr uint8_t LENGTH_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+// Base distances and extra bits of distance symbols 0-29.
+constexpr uint16_t DISTANCE_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+  2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t DISTANCE_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// The order in which the code lengths of the code length alphabet are stored.
+constexpr uint8_t CODE_LENGTH_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// LZ77 parameters for compression.
+constexpr std::size_t WINDOW_SIZE = 32768;
+constexpr unsigned int HASH_BITS = 15;
+constexpr unsigned int MAX_CHAIN = 16;
+constexpr std::size_t MIN_MATCH = 3;
+constexpr std::size_t MAX_MATCH = 258;
+
+uint32_t reverseBits(uint32_t code, unsigned int length) {
+  uint32_t reversed = 0;
+  for (unsigned int i = 0; i < length; ++i) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  return reversed;
+}
+
+/*
+ * Reads bits least significant first, the order deflate packs them in. Reading past the end of
+ * the input yields zeros, and is reported by exhausted().
+ */
+class BitReader {
+ public:
+  explicit BitReader(std::string_view data) : data_ {data} {}
+
+  /*
+   * Returns the next `count` bits, up to 24, without consuming them.
+   */
+  uint32_t peek(unsigned int count) {
+    while (bitCount_ < count) {
+      uint32_t byte = position_ < size(data_) ? static_cast<unsigned char>(data_[position_]) : 0;
+      ++position_;
+      buffer_ |= byte << bitCount_;
+      bitCount_ += 8;
+    }
+    return buffer_ & ((1u << count) - 1);
+  }
+
+  void consume(unsigned int count) {
+    buffer_ >>= count;
+    bitCount_ -= count;
+  }
+
+  uint32_t read(unsigned int count) {
+    uint32_t bits = peek(count);
+    consume(count);
+    return bits;
+  }
+
+  /*
+   * Discards the bits up to the next byte boundary.
+   */
+  void alignToByte() { consume(bitCount_ % 8); }
+
+  /*
+   * Returns the next `count` whole bytes, or fewer at the end of the input. Must be byte aligned.
+   */
+  std::string_view readBytes(std::size_t count) {
+    position_ -= bitCount_ / 8;
+    buffer_ = 0;
+    bitCount_ = 0;
+    std::string_view bytes = position_ < size(data_) ? data_.substr(position_, count) : std::string_view{};
+    position_ += size(bytes);
+    return bytes;
+  }
+
+  /*
+   * Returns true if more bits were consumed than the input holds.
+   */
+  bool exhausted() const { return position_ - bitCount_ / 8 > size(data_); }
+
+ private:
+  std::string_view data_;
+  std::size_t position_ = 0;
+  uint32_t buffer_ = 0;
+  unsigned int bitCount_ = 0;
+};
+
+/*
+ * A canonical Huffman code for decoding. Codes of up to FAST_BITS bits are decoded with one
+ * table lookup, and longer ones a bit at a time.
+ */
+class Huffman {
+ public:
+  /*
+   * Builds the code from the code length of each symbol, where 0 means the symbol is unused.
+   * Returns false if the lengths do not describe a valid code.
+   */
+  bool build(const uint8_t *lengths, unsigned int count) {
+    std::fill(std::begin(counts_), std::end(counts_), uint16_t{0});
+    for (unsigned int symbol = 0; symbol < count; ++symbol) {
+      ++counts_[lengths[symbol]];
+    }
+    counts_[0] = 0;
+    int left = 1;
+    for (unsigned int length = 1; length <= 15; ++length) {
+      left = (left << 1) - counts_[length];
+      if (left < 0) return false;
+    }
+
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (unsigned int length = 1; length < 15; ++length) {
+      offsets[length + 1] = static_cast<uint16_t>(offsets[length] + counts_[length]);
+    }
+    for (unsigned int symbol = 0; symbol < count; ++symbol) {
+      if (lengths[symbol] != 0) symbols_[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+    }
+
+    // Each short code fills every table entry whose low bits are the code, reversed.
+    std::fill(std::begin(fast_), std::end(fast_), uint16_t{0});
+    uint32_t code = 0;
+    unsigned int index = 0;
+    for (unsigned int length = 1; length <= FAST_BITS; ++length) {
+      for (unsigned int i = 0; i < counts_[length]; ++i, ++code) {
+        uint16_t entry = static_cast<uint16_t>(symbols_[index++] << 4 | length);
+        for (uint32_t j = reverseBits(code, length); j < (1u << FAST_BITS); j += 1u << length) {
+          fast_[j] = entry;
+        }
+      }
+      code <<= 1;
+    }
+    return true;
+  }
+
+  /*
+   * Decodes one symbol. Returns -1 if the bits are not a code.
+   */
+  int decode(BitReader &reader) const {
+    uint16_t entry = fast_[reader.peek(FAST_BITS)];
+    if (entry != 0) {
+      reader.consume(entry & 15);
+      return entry >> 4;
+    }
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (unsigned int length = 1; length <= 15; ++length) {
+      code |= static_cast<int>(reader.read(1));
+      int count = counts_[length];
+      if (code - count < first) return symbols_[index + (code - first)];
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    return -1;
+  }
+
+ private:
+  uint16_t fast_[1 << FAST_BITS];  // Symbol << 4 | length, or 0 for longer codes.
+  uint16_t counts_[16];            // Number of codes of each length.
+  uint16_t symbols_[288];          // Symbols ordered by code.
+};
+
+bool buildFixed(Huffman &literals, Huffman &distances) {
+  uint8_t lengths[288];
+  std::fill(lengths, lengths + 144, uint8_t{8});
+  std::fill(lengths + 144, lengths + 256, uint8_t{9});
+  std::fill(lengths + 256, lengths + 280, uint8_t{7});
+  std::fill(lengths + 280, lengths + 288, uint8_t{8});
+  uint8_t distanceLengths[30];
+  std::fill(distanceLengths, distanceLengths + 30, uint8_t{5});
+  return literals.build(lengths, 288) && distances.build(distanceLengths, 30);
+}
+
+bool buildDynamic(BitReader &reader, Huffman &literals, Huffman &distances) {
+  unsigned int literalCount = reader.read(5) + 257;
+  unsigned int distanceCount = reader.read(5) + 1;
+  unsigned int codeLengthCount = reader.read(4) + 4;
+  if (literalCount > 286 || distanceCount > 30) return false;
+
+  uint8_t codeLengths[19] = {};
+  for (unsigned int i = 0; i < codeLengthCount; ++i) {
+    codeLengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(reader.read(3));
+  }
+  Huffman codeLengthCode;
+  if (!codeLengthCode.build(codeLengths, 19)) return false;
+
+  uint8_t lengths[286 + 30] = {};
+  unsigned int total = literalCount + distanceCount;
+  for (unsigned int i = 0; i < total;) {
+    int symbol = codeLengthCode.decode(reader);
+    if (symbol < 0) return false;
+    if (symbol < 16) {
+      lengths[i++] = static_cast<uint8_t>(symbol);
+      continue;
+    }
+    uint8_t repeated = 0;
+    unsigned int count;
+    if (symbol == 16) {
+      if (i == 0) return false;
+      repeated = lengths[i - 1];
+      count = 3 + reader.read(2);
+    } else if (symbol == 17) {
+      count = 3 + reader.read(3);
+    } else {
+      count = 11 + reader.read(7);
+    }
+    if (i + count > total) return false;
+    std::fill(lengths + i, lengths + i + count, repeated);
+    i += count;
+  }
+  if (lengths[256] == 0) return false;
+  return literals.build(lengths, literalCount) && distances.build(lengths + literalCount, distanceCount);
+}
+
+/*
+ * Writes bits least significant first.
+ */
+class BitWriter {
+ public:
+  explicit BitWriter(std::string &out) : out_ {out} {}
+
+  void write(uint32_t bits, unsigned int count) {
+    buffer_ |= static_cast<uint64_t>(bits) << bitCount_;
+    bitCount_ += count;
+    while (bitCount_ >= 8) {
+      out_ += static_cast<char>(buffer_ & 0xff);
+      buffer_ >>= 8;
+      bitCount_ -= 8;
+    }
+  }
+
+  /*
+   * Writes a Huffman code, which deflate packs most significant bit first.
+   */
+  void writeCode(uint32_t code, unsigned int length) { write(reverseBits(code, length), length); }
+
+  void flush() {
+    if (bitCount_ > 0) write(0, 8 - bitCount_);
+  }
+
+ private:
+  std::string &out_;
+  uint64_t buffer_ = 0;
+  unsigned int bitCount_ = 0;
+};
+
+/*
+ * Writes a literal or length symbol with the fixed Huffman code.
+ */
+void writeFixedSymbol(BitWriter &writer, unsigned int symbol) {
+  if (symbol < 144) {
+    writer.writeCode(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    writer.writeCode(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    writer.writeCode(symbol - 256, 7);
+  } else {
+    writer.writeCode(0xc0 + symbol - 280, 8);
+  }
+}
+
+void writeMatch(BitWriter &writer, std::size_t length, std::size_t distance) {
+  unsigned int lengthCode = static_cast<unsigned int>(
+    std::upper_bound(std::begin(LENGTH_BASE), std::end(LENGTH_BASE), length) - std::begin(LENGTH_BASE) - 1);
+  writeFixedSymbol(writer, 257 + lengthCode);
+  writer.write(static_cast<uint32_t>(length - LENGTH_BASE[lengthCode]), LENGTH_EXTRA[lengthCode]);
+  unsigned int distanceCode = static_cast<unsigned int>(
+    std::upper_bound(std::begin(DISTANCE_BASE), std::end(DISTANCE_BASE), distance) - std::begin(DISTANCE_BASE) - 1);
+  writer.writeCode(distanceCode, 5);
+  writer.write(static_cast<uint32_t>(distance - DISTANCE_BASE[distanceCode]), DISTANCE_EXTRA[distanceCode]);
+}
+
+uint32_t adler32(std::string_view data) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  // 5552 bytes is the most that can be summed before b might overflow.
+  while (!data.empty()) {
+    std::size_t chunk = std::min<std::size_t>(size(data), 5552);
+    for (std::size_t i = 0; i < chunk; ++i) {
+      a += static_cast<unsigned char>(data[i]);
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data.remove_prefix(chunk);
+  }
+  return b << 16 | a;
+}
+
+}  // namespace
+
+std::optional<std::string> zlibDecompress(std::string_view input, std::size_t maxSize) {
+  if (size(input) < 2) return std::nullopt;
+  unsigned int method = static_cast<unsigned char>(input[0]);
+  unsigned int flags = static_cast<unsigned char>(input[1]);
+  // Deflate, with a valid header check and no preset dictionary.
+  if ((method & 0x0f) != 8 || (method << 8 | flags) % 31 != 0 || (flags & 0x20) != 0) return std::nullopt;
+
+  BitReader reader {input.substr(2)};
+  std::string out;
+  if (maxSize != SIZE_MAX) out.reserve(maxSize);
+  Huffman literals;
+  Huffman distances;
+  bool last = false;
+  while (!last) {
+    last = reader.read(1) != 0;
+    unsigned int type = reader.read(2);
+    if (type == 0) {
+      reader.alignToByte();
+      uint32_t length = reader.read(16);
+      uint32_t complement = reader.read(16);
+      if (length != (~complement & 0xffff)) return std::nullopt;
+      std::string_view bytes = reader.readBytes(length);
+      if (size(bytes) != length || length > maxSize - size(out)) return std::nullopt;
+      out.append(bytes);
+      continue;
+    }
+    if (type == 1) {
+      buildFixed(literals, distances);
+    } else if (type != 2 || !buildDynamic(reader, literals, distances)) {
+      return std::nullopt;
+    }
+
+    for (;;) {
+      int symbol = literals.decode(reader);
+      if (symbol < 0 || reader.exhausted()) return std::nullopt;
+      if (symbol < 256) {
+        if (size(out) == maxSize) return std::nullopt;
+        out += static_cast<char>(symbol);
+        continue;
+      }
+      if (symbol == 256) break;
+      symbol -= 257;
+      if (symbol >= 29) return std::nullopt;
+      std::size_t length = LENGTH_BASE[symbol] + reader.read(LENGTH_EXTRA[symbol]);
+      int distanceSymbol = distances.decode(reader);
+      if (distanceSymbol < 0 || distanceSymbol >= 30) return std::nullopt;
+      std::size_t distance = DISTANCE_BASE[distanceSymbol] + reader.read(DISTANCE_EXTRA[distanceSymbol]);
+      if (distance > size(out) || length > maxSize - size(out)) return std::nullopt;
+      std::size_t from = size(out) - distance;
+      if (distance >= length) {
+        out.append(out, from, length);
+      } else {
+        // The match overlaps the bytes it produces.
+        for (std::size_t i = 0; i < length; ++i) {
+          out += out[from + i];
+        }
+      }
+    }
+  }
+  if (reader.exhausted()) return std::nullopt;
+  return out;
+}
+
+std::string zlibCompress(std::string_view input) {
+  std::string out;
+  out.reserve(size(input) / 2 + 64);
+  // Deflate with a 32K window, at the fastest compression level.
+  out += static_cast<char>(0x78);
+  out += static_cast<char>(0x01);
+
+  BitWriter writer {out};
+  // A single final block with fixed Huffman codes.
+  writer.write(1, 1);
+  writer.write(1, 2);
+
+  auto bytes = reinterpret_cast<const unsigned char *>(input.data());
+  std::size_t length = size(input);
+  std::vector<int32_t> head(std::size_t{1} << HASH_BITS, -1);
+  std::vector<int32_t> previous(WINDOW_SIZE, -1);
+  auto hash = [bytes](std::size_t i) {
+    uint32_t value = uint32_t{bytes[i]} << 16 | uint32_t{bytes[i + 1]} << 8 | bytes[i + 2];
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+  };
+  auto insert = [&](std::size_t i) {
+    if (i + MIN_MATCH > length) return;
+    uint32_t h = hash(i);
+    previous[i % WINDOW_SIZE] = head[h];
+    head[h] = static_cast<int32_t>(i);
+  };
+
+  std::size_t i = 0;
+  while (i < length) {
+    std::size_t bestLength = 0;
+    std::size_t bestDistance = 0;
+    if (i + MIN_MATCH <= length) {
+      std::size_t limit = std::min(MAX_MATCH, length - i);
+      int32_t candidate = head[hash(i)];
+      for (unsigned int chain = 0; chain < MAX_CHAIN && candidate >= 0; ++chain) {
+        std::size_t start = static_cast<std::size_t>(candidate);
+        if (i - start > WINDOW_SIZE - 1) break;
+        std::size_t matched = 0;
+        while (matched < limit && bytes[start + matched] == bytes[i + matched]) {
+          ++matched;
+        }
+        if (matched > bestLength) {
+          bestLength = matched;
+          bestDistance = i - start;
+          if (matched == limit) break;
+        }
+        int32_t next = previous[start % WINDOW_SIZE];
+        if (next >= candidate) break;
+        candidate = next;
+      }
+    }
+
+    if (bestLength >= MIN_MATCH) {
+      writeMatch(writer, bestLength, bestDistance);
+      for (std::size_t j = 0; j < bestLength; ++j) {
+        insert(i + j);
+      }
+      i += bestLength;
+    } else {
+      writeFixedSymbol(writer, bytes[i]);
+      insert(i);
+      ++i;
+    }
+  }
+  writeFixedSymbol(writer, 256);
+  writer.flush();
+
+  uint32_t checksum = adler32(input);
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out += static_cast<char>((checksum >> shift) & 0xff);
+  }
+  return out;
+}
+
+}  // namespace dcurses
@@ -0,0 +1,36 @@
+// Copyright 2022 Daniel Liu
+
+// Zlib.hpp
+// zlib stream compression and decompression, for PNG images.
+
+#ifndef DCURSES_ZLIB_HPP_
+#define DCURSES_ZLIB_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace dcurses {
+
+/*
+ * Decompresses a zlib stream (RFC 1950 and 1951).
+ * @param input The compressed stream.
+ * @param maxSize The largest output allowed. When it is given, it is reserved up front.
+ * @return The decompressed data, or std::nullopt if the stream is malformed or would decompress
+ *   to more than maxSize bytes.
+ */
+std::optional<std::string> zlibDecompress(std::string_view input, std::size_t maxSize = SIZE_MAX);
+
+/*
+ * Compresses data into a zlib stream, using fixed Huffman codes and greedy LZ77 matching. This
+ * favors speed over size.
+ * @param input The data to compress.
+ * @return The compressed stream.
+ */
+std::string zlibCompress(std::string_view input);
+
+}  // namespace dcurses
+
+#endif
@@ -0,0 +1,77 @@
+// Copyright 2022 Daniel Liu
+
+// Non-interactive batch editing.
+
+#include "Batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "Editor.hpp"
+
+namespace dvim {
+
+unsigned int runBatch(const std::string &keys,
+                      const std::vector<std::filesystem::path> &paths,
+                      unsigned int jobs) {
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  jobs = std::min(jobs, static_cast<unsigned int>(size(paths)));
+
+  std::atomic<std::size_t> next {0};
+  std::atomic<unsigned int> failures {0};
+  std::mutex errorMutex;
+
+  auto worker = [&]() {
+    for (auto i = next++; i < size(paths); i = next++) {
+      const auto &path = paths[i];
+      std::string error;
+      std::error_code ec;
+      if (!std::filesystem::is_regular_file(path, ec)) {
+        error = ec ? ec.message() : "not a regular file";
+      } else {
+        // A failure on one file must not take the other workers down with it.
+        try {
+          Editor editor {path};
+          for (char key : keys) {
+            editor.handleInput(key);
+            if (editor.getMode() == "STOPPED") {
+              break;
+            }
+          }
+          if (editor.isModified() && !editor.save()) {
+            error = editor.getErrorMessage();
+          }
+        } catch (const std::exception &e) {
+          error = e.what();
+        }
+      }
+      if (!error.empty()) {
+        ++failures;
+        std::lock_guard<std::mutex> lock {errorMutex};
+        std::cerr << path.string() << ": " << error << "\n";
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < jobs; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return failures;
+}
+
+}  // namespace dvim
@@ -0,0 +1,29 @@
+// Copyright 2022 Daniel Liu
+
+// Non-interactive batch editing.
+
+#ifndef DVIM_BATCH_HPP_
+#define DVIM_BATCH_HPP_
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace dvim {
+
+/*
+ * Replays the keys against each of the files, without rendering, and writes
+ * back every file that was modified. Files are processed in parallel on a pool
+ * of worker threads.
+ * @param keys The keys to replay, as parsed by parseKeyScript.
+ * @param paths The files to edit.
+ * @param jobs The number of worker threads to use. 0 uses one per core.
+ * @return The number of files that could not be edited or written.
+ */
+unsigned int runBatch(const std::string &keys,
+                      const std::vector<std::filesystem::path> &paths,
+                      unsigned int jobs = 0);
+
+}  // namespace dvim
+
+#endif
@@ -4,29 +4,197 @@
 
 #include "Editor.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <regex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "Logging.hpp"
 #include "dcurses/Window.hpp"
 #include "Utilities.hpp"
 
 namespace dvim {
 
+namespace {
+
+// FNV-1a hash of a line, used to find the lines that changed on disk.
+template <typename Iterator>
+std::uint64_t hashLine(Iterator first, Iterator last) {
+  std::uint64_t hash = 14695981039346656037ull;
+  for (; first != last; ++first) {
+    hash ^= static_cast<unsigned char>(*first);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Character classes used by word motions. A word is a run of characters of the
+// same class; a WORD is any run of non-blank characters.
+enum CharClass : unsigned char {
+  BLANK,
+  PUNCTUATION,
+  WORDCHAR
+};
+
+constexpr std::array<unsigned char, 256> makeCharClassTable() {
+  std::array<unsigned char, 256> table {};
+  for (unsigned int c = 0; c < 256; ++c) {
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') {
+      table[c] = BLANK;
+    } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+      (c >= '0' && c <= '9') || c == '_' || c >= 0x80) {
+      // Bytes of multibyte UTF-8 sequences are treated as word characters.
+      table[c] = WORDCHAR;
+    } else {
+      table[c] = PUNCTUATION;
+    }
+  }
+  return table;
+}
+
+constexpr std::array<unsigned char, 256> CHAR_CLASSES = makeCharClassTable();
+
+// Parses a string of decimal digits, such as a count or register number. Numbers above `limit`
+// are returned as `limit`, so that long numbers neither throw nor wrap around.
+unsigned int parseDecimal(const std::string &digits, unsigned int limit) {
+  std::uint64_t number = 0;
+  for (char digit : digits) {
+    number = number * 10 + static_cast<std::uint64_t>(digit - '0');
+    if (number > limit) return limit;
+  }
+  return static_cast<unsigned int>(number);
+}
+
+}  // namespace
+
 Editor::Editor(const std::filesystem::path &path,
-  dcurses::WindowManager& manager) : manager_(manager), path_(path) {
-  std::string line;
-  std::ifstream fin(path);
-  while (std::getline(fin, line)) {
-    lines_.emplace_back(std::list<char>(begin(line), end(line)));
+  dcurses::WindowManager& manager) : Editor(path) {
+  manager_ = &manager;
+}
+
+Editor::Editor(const std::filesystem::path &path) : path_(path) {
+  loadFile(false);
+}
+
+bool Editor::loadFile(bool incremental) {
+  std::ifstream fin(path_, std::ios::binary);
+  if (!fin && !lines_.empty()) {
+    return false;
   }
-  cursorLineIterator_ = begin(lines_);
-  cursorColIterator_ = begin(*cursorLineIterator_);
+  std::stringstream contentstream;
+  contentstream << fin.rdbuf();
+  std::string contents = contentstream.str();
+
+  // Split into lines and hash them. An empty file has one empty line.
+  std::vector<std::string_view> newLines;
+  std::vector<std::uint64_t> newHashes;
+  for (std::size_t start = 0; start < size(contents);) {
+    auto lineEnd = contents.find('\n', start);
+    if (lineEnd == std::string::npos) {
+      lineEnd = size(contents);
+    }
+    newLines.emplace_back(contents.data() + start, lineEnd - start);
+    newHashes.push_back(hashLine(begin(newLines.back()), end(newLines.back())));
+    start = lineEnd + 1;
+  }
+  if (newLines.empty()) {
+    newLines.emplace_back();
+    newHashes.push_back(hashLine(begin(newLines.back()), end(newLines.back())));
+  }
+
+  std::size_t oldCount = size(lines_);
+  std::size_t newCount = size(newLines);
+  std::size_t prefix = 0;
+  std::size_t suffix = 0;
+  if (incremental && size(lineHashes_) == oldCount) {
+    // Only replace the lines between the unchanged prefix and suffix.
+    while (prefix < oldCount && prefix < newCount && lineHashes_[prefix] == newHashes[prefix]) {
+      ++prefix;
+    }
+    while (suffix < oldCount - prefix && suffix < newCount - prefix &&
+      lineHashes_[oldCount - 1 - suffix] == newHashes[newCount - 1 - suffix]) {
+      ++suffix;
+    }
+  }
+
+  if (prefix + suffix != oldCount || prefix + suffix != newCount) {
+    auto lit = begin(lines_);
+    if (prefix <= oldCount / 2) {
+      std::advance(lit, prefix);
+    } else {
+      lit = end(lines_);
+      std::advance(lit, -static_cast<std::ptrdiff_t>(oldCount - prefix));
+    }
+    auto eraseEnd = lit;
+    std::advance(eraseEnd, oldCount - prefix - suffix);
+    lit = lines_.erase(lit, eraseEnd);
+    for (std::size_t i = prefix; i < newCount - suffix; ++i) {
+      lines_.emplace(lit, begin(newLines[i]), end(newLines[i]));
+    }
+    LOG("Reloaded lines " + std::to_string(prefix) + " to " + std::to_string(newCount - suffix));
+  }
+  lineHashes_ = std::move(newHashes);
+  modified_ = false;
+  changedOnDisk_ = false;
+  recordDiskState();
+
+  // Put the cursor back on the same line and column, if they still exist.
+  if (isVisualMode()) {
+    mode = EditorMode::NORMAL;
+  }
+  unsigned int lineIndex = std::min(cursorLine_, static_cast<unsigned int>(size(lines_) - 1));
+  auto lit = begin(lines_);
+  std::advance(lit, lineIndex);
+  setCursorPosition(positionAt(lit, lineIndex, cursorColumn_));
+  return true;
+}
+
+void Editor::recordDiskState() {
+  std::error_code ec;
+  diskTime_ = std::filesystem::last_write_time(path_, ec);
+  diskSize_ = std::filesystem::file_size(path_, ec);
+}
+
+bool Editor::diskStateChanged() const {
+  std::error_code ec;
+  auto time = std::filesystem::last_write_time(path_, ec);
+  if (ec) {
+    return false;
+  }
+  auto fileSize = std::filesystem::file_size(path_, ec);
+  return !ec && (time != diskTime_ || fileSize != diskSize_);
+}
+
+void Editor::handleExternalChange() {
+  if (!diskStateChanged()) {
+    // Unchanged, e.g. the event came from our own save.
+    return;
+  }
+  if (modified_) {
+    changedOnDisk_ = true;
+    errorMessage_ = "File changed on disk; :e! to reload, :w! to overwrite";
+    mode = EditorMode::ERROR;
+    return;
+  }
+  loadFile(true);
 }
 
 void Editor::handleInput(char ch) {
@@ -46,11 +214,16 @@ void Editor::handleInput(char ch) {
       commandInput(ch);
       break;
     case EditorMode::VISUAL:
+    case EditorMode::VISUAL_LINE:
+    case EditorMode::VISUAL_BLOCK:
       visualInput(ch);
       break;
     case EditorMode::REGWINDOW:
       regWindowInput(ch);
       break;
+    case EditorMode::PERFWINDOW:
+      perfWindowInput(ch);
+      break;
   }
 }
 
@@ -100,12 +273,176 @@ void Editor::moveCursorRight() {
   }
 }
 
+Editor::Position Editor::cursorPosition() {
+  return { cursorLineIterator_, cursorColIterator_, cursorLine_, cursorColumn_ };
+}
+
+void Editor::setCursorPosition(const Position &position) {
+  cursorLineIterator_ = position.line;
+  cursorColIterator_ = position.col;
+  cursorLine_ = position.lineIndex;
+  cursorColumn_ = position.colIndex;
+  // Outside of insert mode, the cursor may only rest on a line break if the
+  // line is empty.
+  if (mode != EditorMode::INSERT && cursorColIterator_ == end(*cursorLineIterator_) &&
+    cursorColIterator_ != begin(*cursorLineIterator_)) {
+    --cursorColIterator_;
+    --cursorColumn_;
+  }
+}
+
+bool Editor::advancePosition(Position &position) {
+  if (position.col != end(*position.line)) {
+    ++position.col;
+    ++position.colIndex;
+    return true;
+  }
+  auto nextLine = position.line;
+  ++nextLine;
+  if (nextLine == end(lines_)) {
+    return false;
+  }
+  position.line = nextLine;
+  position.col = begin(*nextLine);
+  ++position.lineIndex;
+  position.colIndex = 0;
+  return true;
+}
+
+bool Editor::retreatPosition(Position &position) {
+  if (position.col != begin(*position.line)) {
+    --position.col;
+    --position.colIndex;
+    return true;
+  }
+  if (position.line == begin(lines_)) {
+    return false;
+  }
+  --position.line;
+  position.col = end(*position.line);
+  --position.lineIndex;
+  position.colIndex = static_cast<unsigned int>(size(*position.line));
+  return true;
+}
+
+unsigned char Editor::classAt(const Position &position, bool bigWord) const {
+  if (position.col == end(*position.line)) {
+    return BLANK;
+  }
+  unsigned char cls = CHAR_CLASSES[static_cast<unsigned char>(*position.col)];
+  if (bigWord && cls != BLANK) {
+    return WORDCHAR;
+  }
+  return cls;
+}
+
+Editor::Position Editor::nextWordStart(Position position, bool bigWord) {
+  // Skip the rest of the current word.
+  unsigned char cls = classAt(position, bigWord);
+  if (cls != BLANK) {
+    while (advancePosition(position) && classAt(position, bigWord) == cls) {}
+  }
+  // Skip blanks and line breaks; an empty line counts as a word.
+  while (classAt(position, bigWord) == BLANK) {
+    bool atLineBreak = position.col == end(*position.line);
+    if (!advancePosition(position)) {
+      break;
+    }
+    if (atLineBreak && position.line->empty()) {
+      break;
+    }
+  }
+  return position;
+}
+
+Editor::Position Editor::nextWordEnd(Position position, bool bigWord) {
+  if (!advancePosition(position)) {
+    return position;
+  }
+  while (classAt(position, bigWord) == BLANK) {
+    if (!advancePosition(position)) {
+      return position;
+    }
+  }
+  unsigned char cls = classAt(position, bigWord);
+  auto next = position;
+  while (advancePosition(next) && classAt(next, bigWord) == cls) {
+    position = next;
+  }
+  return position;
+}
+
+Editor::Position Editor::prevWordStart(Position position, bool bigWord) {
+  if (!retreatPosition(position)) {
+    return position;
+  }
+  // Skip blanks and line breaks; an empty line counts as a word.
+  while (classAt(position, bigWord) == BLANK && !position.line->empty()) {
+    if (!retreatPosition(position)) {
+      return position;
+    }
+  }
+  unsigned char cls = classAt(position, bigWord);
+  auto prev = position;
+  while (retreatPosition(prev) && classAt(prev, bigWord) == cls &&
+    prev.col != end(*prev.line)) {
+    position = prev;
+  }
+  return position;
+}
+
+std::string Editor::textInRange(Position from, Position to) const {
+  // Returns the text in [from, to), with line breaks as newlines.
+  if (from.line == to.line) {
+    return std::string(from.col, to.col);
+  }
+  std::string text(from.col, end(*from.line));
+  text += '\n';
+  auto lit = from.line;
+  for (++lit; lit != to.line; ++lit) {
+    text.append(begin(*lit), end(*lit));
+    text += '\n';
+  }
+  text.append(begin(*to.line), to.col);
+  return text;
+}
+
+Editor::Position Editor::positionAt(std::list<std::list<char>>::iterator line,
+                                    unsigned int lineIndex, unsigned int colIndex) {
+  colIndex = std::min(colIndex, static_cast<unsigned int>(size(*line)));
+  auto col = begin(*line);
+  std::advance(col, colIndex);
+  return { line, col, lineIndex, colIndex };
+}
+
+void Editor::deleteRange(Position from, Position to) {
+  // Deletes [from, to), saving the deleted text into the active register.
+  // An empty range deletes nothing, and leaves the register alone.
+  if (from.lineIndex == to.lineIndex && from.colIndex == to.colIndex) return;
+  std::string removed = textInRange(from, to);
+  if (from.line == to.line) {
+    from.line->erase(from.col, to.col);
+  } else {
+    from.line->erase(from.col, end(*from.line));
+    from.line->splice(end(*from.line), *to.line, to.col, end(*to.line));
+    auto eraseBegin = from.line;
+    auto eraseEnd = to.line;
+    lines_.erase(++eraseBegin, ++eraseEnd);
+  }
+  registers_[activeRegister_] = removed;
+  modified_ = true;
+
+  from.col = begin(*from.line);
+  std::advance(from.col, from.colIndex);
+  setCursorPosition(from);
+}
+
 void Editor::normalInput(char c) {
   if (queuedActions_ != "") {
     std::smatch match;
     unsigned int repetitions = 1;
     if (std::regex_match(queuedActions_, match, std::regex{"([0-9]+)(.*)"})) {
-      repetitions = static_cast<unsigned int>(std::stoul(match[1].str()));
+      repetitions = parseDecimal(match[1].str(), UINT_MAX);
       queuedActions_ = match[2].str();
     }
     for (unsigned int i = 0; i < repetitions; ++i) {
@@ -148,6 +485,7 @@ void Editor::normalInput(char c) {
       // Enter insert mode on a new line
       {
         mode = EditorMode::INSERT;
+        modified_ = true;
         auto nextLineIterator = cursorLineIterator_;
         ++nextLineIterator;
         lines_.emplace(nextLineIterator, std::list<char>());
@@ -162,6 +500,7 @@ void Editor::normalInput(char c) {
       // Enter insert mode one line before
       {
         mode = EditorMode::INSERT;
+        modified_ = true;
         lines_.emplace(cursorLineIterator_, std::list<char>());
         --cursorLineIterator_;
         cursorColIterator_ = begin(*cursorLineIterator_);
@@ -172,26 +511,17 @@ void Editor::normalInput(char c) {
 
     case 'v':
       // Enter visual mode at the current position
-      mode = EditorMode::VISUAL;
-      visualStartLine_ = cursorLine_;
-      visualStartColumn_ = cursorColumn_;
-      visualStartLineIterator_ = cursorLineIterator_;
-      visualStartColIterator_ = cursorColIterator_;
+      enterVisualMode(EditorMode::VISUAL);
       break;
     
     case 'V':
       // Enter visual mode with the current line selected
-      mode = EditorMode::VISUAL;
-      {
-        visualStartLineIterator_ = cursorLineIterator_;
-        visualStartColIterator_ = begin(*cursorLineIterator_);
-        visualStartLine_ = cursorLine_;
-        visualStartColumn_ = 0;
+      enterVisualMode(EditorMode::VISUAL_LINE);
+      break;
 
-        cursorColumn_ = static_cast<unsigned int>(size(*cursorLineIterator_) - 1);
-        cursorColIterator_ = begin(*cursorLineIterator_);
-        std::advance(cursorColIterator_, cursorColumn_);
-      }
+    case '\x16':
+      // Ctrl-V: enter blockwise visual mode
+      enterVisualMode(EditorMode::VISUAL_BLOCK);
       break;
 
     default:
@@ -210,8 +540,11 @@ bool Editor::isSingleNavigationAction(char c) {
     case 'k':
     case 'l':
     case 'w':
+    case 'W':
     case 'e':
+    case 'E':
     case 'b':
+    case 'B':
     case '^':
     case '$':
     case 'p':
@@ -260,54 +593,21 @@ void Editor::executeNormalAction(char c) {
       break;
 
     case 'w':
+    case 'W':
       // Move to the beginning of the next word
-      {
-        moveCursorRight();
-        auto nextChar = cursorColIterator_;
-        ++nextChar;
-        while (*cursorColIterator_ != ' ' && nextChar != end(*cursorLineIterator_)) {
-          ++cursorColIterator_;
-          ++cursorColumn_;
-          ++nextChar;
-        }
-        moveCursorRight();
-      }
+      setCursorPosition(nextWordStart(cursorPosition(), c == 'W'));
       break;
 
     case 'e':
-      // Move to the end of the current word
-      {
-        auto nextChar = cursorColIterator_;
-        ++nextChar;
-        if (*nextChar == ' ') {
-          moveCursorRight();
-          ++nextChar;
-        }
-        while (*nextChar != ' ' && nextChar != end(*cursorLineIterator_)) {
-          ++cursorColIterator_;
-          ++cursorColumn_;
-          ++nextChar;
-        }
-      }
+    case 'E':
+      // Move to the end of the next word
+      setCursorPosition(nextWordEnd(cursorPosition(), c == 'E'));
       break;
-    
+
     case 'b':
+    case 'B':
       // Move to the beginning of the previous word
-      {
-        if (cursorColIterator_ == begin(*cursorLineIterator_)) {
-          break;
-        }
-        auto prevChar = cursorColIterator_;
-        --prevChar;
-        if (*prevChar == ' ') {
-          moveCursorLeft();
-          --prevChar;
-        }
-        while (cursorColIterator_ != begin(*cursorLineIterator_) && *prevChar != ' ') {
-          moveCursorLeft();
-          --prevChar;
-        }
-      }
+      setCursorPosition(prevWordStart(cursorPosition(), c == 'B'));
       break;
 
     case '^':
@@ -341,6 +641,7 @@ void Editor::executeNormalAction(char c) {
         }
         cursorLineIterator_->erase(cursorColIterator_);
         cursorColIterator_ = newColIterator;
+        modified_ = true;
       }
       break;
 
@@ -348,6 +649,7 @@ void Editor::executeNormalAction(char c) {
       // Paste register content after cursor.
       {
         auto toPaste = registers_[activeRegister_];
+        modified_ = true;
         ++cursorColIterator_;
         for (auto c : toPaste) {
           if (c == '\n') {
@@ -380,6 +682,7 @@ void Editor::executeNormalAction(char c) {
 }
 
 void Editor::executeDeleteAction(char c) {
+  // A delete that removes nothing leaves the register and the modified flag alone, as in vim.
   switch (c) {
     case 'h':
       // Delete previous character
@@ -392,6 +695,7 @@ void Editor::executeDeleteAction(char c) {
         registers_[activeRegister_] = std::string{*prev};
         cursorLineIterator_->erase(prev);
         --cursorColumn_;
+        modified_ = true;
       }
       break;
     case 'j':
@@ -420,6 +724,7 @@ void Editor::executeDeleteAction(char c) {
         cursorLineIterator_ = newLine;
         cursorColIterator_ = begin(*cursorLineIterator_);
         cursorColumn_ = 0;
+        modified_ = true;
       }
       break;
     case 'k':
@@ -449,11 +754,15 @@ void Editor::executeDeleteAction(char c) {
         cursorColIterator_ = begin(*cursorLineIterator_);
         --cursorLine_;
         cursorColumn_ = 0;
+        modified_ = true;
       }
       break;
     case 'l':
       // Delete current character
       {
+        if (cursorColIterator_ == end(*cursorLineIterator_)) {
+          break;
+        }
         auto next = cursorColIterator_;
         ++next;
         if (next == end(*cursorLineIterator_)) {
@@ -464,63 +773,39 @@ void Editor::executeDeleteAction(char c) {
         registers_[activeRegister_] = std::string{*cursorColIterator_};
         cursorLineIterator_->erase(cursorColIterator_);
         cursorColIterator_ = next;
+        modified_ = true;
       }
       break;
     case 'w':
-      // Delete until a space has been deleted
+    case 'W':
+      // Delete until the beginning of the next word, stopping at the end of
+      // the current line
       {
-        bool spaceDeleted = false;
-        std::string toCopy = "";
-        while (!spaceDeleted && cursorColIterator_ != end(*cursorLineIterator_)) {
-          auto next = cursorColIterator_;
-          ++next;
-          toCopy += std::string{*cursorColIterator_};
-          spaceDeleted = *cursorColIterator_ == ' ';
-          cursorLineIterator_->erase(cursorColIterator_);
-          cursorColIterator_ = next;
+        auto from = cursorPosition();
+        auto to = nextWordStart(from, c == 'W');
+        if (to.line != from.line) {
+          to = { from.line, end(*from.line), from.lineIndex,
+            static_cast<unsigned int>(size(*from.line)) };
         }
-        registers_[activeRegister_] = toCopy;
+        deleteRange(from, to);
       }
       break;
     case 'e':
-      // Delete until some characters have been deleted and a space is reached
+    case 'E':
+      // Delete until the end of the next word, inclusive
       {
-        bool nonSpaceDeleted = false;
-        std::string toCopy = "";
-        while (!(nonSpaceDeleted && *cursorColIterator_ == ' ') && 
-          cursorColIterator_ != end(*cursorLineIterator_)) {
-          auto next = cursorColIterator_;
-          ++next;
-          toCopy += std::string{*cursorColIterator_};
-          nonSpaceDeleted = *cursorColIterator_ != ' ';
-          cursorLineIterator_->erase(cursorColIterator_);
-          cursorColIterator_ = next;
-        }
-        registers_[activeRegister_] = toCopy;
+        auto from = cursorPosition();
+        auto to = nextWordEnd(from, c == 'E');
+        advancePosition(to);
+        deleteRange(from, to);
       }
       break;
     case 'b':
-      // Delete previous characters until space is reached
+    case 'B':
+      // Delete from the beginning of the previous word to the cursor
       {
-        if (cursorColIterator_ == begin(*cursorLineIterator_)) {
-          break;
-        }
-        --cursorColIterator_;
-        bool nonSpaceDeleted = false;
-        std::string toCopy = "";
-        while (!(nonSpaceDeleted && *cursorColIterator_ == ' ') && 
-          cursorColIterator_ != end(*cursorLineIterator_)) {
-          auto prev = cursorColIterator_;
-          --prev;
-          --cursorColumn_;
-          toCopy += std::string{*cursorColIterator_};
-          nonSpaceDeleted = *cursorColIterator_ != ' ';
-          cursorLineIterator_->erase(cursorColIterator_);
-          cursorColIterator_ = prev;
-        }
-        ++cursorColIterator_;
-        toCopy = std::string{rbegin(toCopy), rend(toCopy)};
-        registers_[activeRegister_] = toCopy;
+        auto to = cursorPosition();
+        deleteRange(prevWordStart(to, c == 'B'), to);
       }
       break;
     default:
@@ -540,7 +825,10 @@ void Editor::insertInput(char c) {
       cursorColIterator_ = begin(*cursorLineIterator_);
       std::advance(cursorColIterator_, cursorColumn_);
     }
-  } else if (c == '\r') {
+    return;
+  }
+  modified_ = true;
+  if (c == '\r') {
     // Special case of new line
     auto newLine = std::list<char>();
     auto nextLineIterator = cursorLineIterator_;
@@ -612,46 +900,80 @@ void Editor::commandInput(char c) {
 }
 
 void Editor::executeCommand() {
-  if (queuedActions_ == "reg show") {
+  if (queuedActions_ == "reg show" && manager_ == nullptr) {
+    errorMessage_ = "reg show is not available without a window";
+    mode = EditorMode::ERROR;
+  } else if (queuedActions_ == "reg show") {
     // Open register window
     mode = EditorMode::REGWINDOW;
-    auto editor = manager_["editor"];
-    manager_.addWindow("registers",
-      { editor->row() + 4, editor->col() + 8, editor->width() - 16, editor->height() - 8, 4, DEFAULT_BORDER}
-    );
-    auto window = manager_["registers"];
-
-    window->setString(2, 3, "Registers");
-    window->setString(3, 3, "=========");
+    auto editor = manager_->settings(window_);
+    registersWindow_ = manager_->addWindow(
+      {editor.row + 4, editor.col + 8, editor.width - 16, editor.height - 8, 4, DEFAULT_BORDER});
+    auto &window = (*manager_)[registersWindow_];
+
+    window.setString(2, 3, "Registers");
+    window.setString(3, 3, "=========");
     for (unsigned int i = 0; i < NUM_REGS; ++i) {
       if (i == activeRegister_) {
-        window->setString(4 + i, 3, std::to_string(i) + "*: " + dvim::escapeString(registers_[i]));
+        window.setString(4 + i, 3, std::to_string(i) + "*: " + dvim::escapeString(registers_[i]));
       } else {
-        window->setString(4 + i, 3, std::to_string(i) + " : " + dvim::escapeString(registers_[i]));
+        window.setString(4 + i, 3, std::to_string(i) + " : " + dvim::escapeString(registers_[i]));
       }
     }
+  } else if (queuedActions_ == "perf" && manager_ == nullptr) {
+    errorMessage_ = "perf is not available without a window";
+    mode = EditorMode::ERROR;
+  } else if (queuedActions_ == "perf") {
+    // Open render counters window
+    mode = EditorMode::PERFWINDOW;
+    auto editor = manager_->settings(window_);
+    perfWindow_ = manager_->addWindow(
+      {editor.row + 4, editor.col + 8, editor.width - 16, editor.height - 8, 4, DEFAULT_BORDER});
+    auto &window = (*manager_)[perfWindow_];
+
+    const auto &stats = manager_->stats();
+    window.setString(2, 3, "Render counters (" + std::to_string(stats.framesRecorded()) + " frames)");
+    window.setString(3, 3, "===============");
+    auto lines = stats.summary();
+    for (unsigned int i = 0; i < size(lines); ++i) {
+      window.setString(4 + i, 3, lines[i]);
+    }
   } else if (std::regex_match(queuedActions_, std::regex{"reg select ([0-9]+)"})) {
     // Select register
     std::smatch matchResult;
     std::regex_match(queuedActions_, matchResult, 
       std::regex{"reg select ([0-9]+)"});
-    unsigned int newRegister = static_cast<unsigned int>(std::stoul(matchResult[1].str()));
+    unsigned int newRegister = parseDecimal(matchResult[1].str(), NUM_REGS);
     if (newRegister < NUM_REGS) {
       activeRegister_ = newRegister;
     }
+  } else if (std::smatch command; std::regex_match(queuedActions_, command,
+    std::regex{"(%|[.$]|[0-9]+)?(?:,([.$]|[0-9]+))?s([^A-Za-z0-9 \\\\])(.*)"})) {
+    executeSubstitute(command);
+  } else if (queuedActions_ == "w!") {
+    // Write, even if the file changed on disk
+    save();
+  } else if (queuedActions_ == "e!") {
+    // Reload, discarding changes. If the file is gone there is nothing left to conflict with, so
+    // keep the buffer and let :w write it back.
+    if (!loadFile(false)) {
+      changedOnDisk_ = false;
+      errorMessage_ = "Cannot read " + path_.string() + "; buffer kept";
+      mode = EditorMode::ERROR;
+    }
   } else if (std::regex_match(queuedActions_, std::regex{"[wq]+"})) {
     for (char c : queuedActions_) {
       if (c == 'w') {
-        // Write
-        std::ofstream fout(path_);
-        for (auto lit = begin(lines_); lit != end(lines_); ++lit) {
-          for (auto cit = begin(*lit); cit != end(*lit); ++cit) {
-            fout << *cit;
-          }
-          fout << "\n";
+        // Write. Change notifications can be lost (or unavailable), so check the file itself too.
+        if (changedOnDisk_ || diskStateChanged()) {
+          changedOnDisk_ = true;
+          errorMessage_ = "File changed on disk; :w! to overwrite";
+          mode = EditorMode::ERROR;
+          break;
+        }
+        if (!save()) {
+          break;
         }
-        fout.flush();
-        fout.close();
       } else if (c == 'q') {
         // Quit
         mode = EditorMode::STOPPED;
@@ -664,12 +986,344 @@ void Editor::executeCommand() {
   queuedActions_ = "";
 }
 
+void Editor::executeSubstitute(const std::smatch &command) {
+  // Resolve the range, which defaults to the cursor line.
+  unsigned int numLines = static_cast<unsigned int>(size(lines_));
+  auto lineNumber = [&](const std::string &address) -> unsigned int {
+    if (address == "." || address.empty()) return cursorLine_ + 1;
+    if (address == "$") return numLines;
+    // Line numbers past the end are returned as 0, which is reported as an invalid range.
+    unsigned int number = parseDecimal(address, numLines + 1);
+    return number > numLines ? 0 : number;
+  };
+  unsigned int firstLine = 1;
+  unsigned int lastLine = numLines;
+  if (command[1].str() != "%") {
+    firstLine = lineNumber(command[1].str());
+    lastLine = command[2].matched ? lineNumber(command[2].str()) : firstLine;
+  }
+  if (firstLine == 0 || firstLine > lastLine || lastLine > numLines) {
+    errorMessage_ = "Invalid range";
+    mode = EditorMode::ERROR;
+    return;
+  }
+
+  // Split pattern/replacement/flags on the delimiter, which can be escaped.
+  char delimiter = command[3].str()[0];
+  std::string parts[3];
+  unsigned int part = 0;
+  std::string rest = command[4].str();
+  for (std::size_t i = 0; i < size(rest); ++i) {
+    if (rest[i] == '\\' && i + 1 < size(rest) && rest[i + 1] == delimiter) {
+      parts[part] += delimiter;
+      ++i;
+    } else if (rest[i] == delimiter && part < 2) {
+      ++part;
+    } else {
+      parts[part] += rest[i];
+    }
+  }
+  if (parts[0].empty()) {
+    errorMessage_ = "Empty pattern";
+    mode = EditorMode::ERROR;
+    return;
+  }
+  bool global = parts[2].find('g') != std::string::npos;
+  bool ignoreCase = parts[2].find('i') != std::string::npos;
+
+  try {
+    Substitution substitution {parts[0], parts[1], global, ignoreCase};
+    if (substitute(firstLine - 1, lastLine - 1, substitution) == 0) {
+      errorMessage_ = "Pattern not found: " + parts[0];
+      mode = EditorMode::ERROR;
+    }
+  } catch (const std::regex_error &) {
+    errorMessage_ = "Invalid pattern: " + parts[0];
+    mode = EditorMode::ERROR;
+  }
+}
+
+unsigned int Editor::substitute(unsigned int firstLine, unsigned int lastLine,
+                                const Substitution &substitution) {
+  // Each line is copied into a reused buffer and searched there. Only lines
+  // with a match are rebuilt, from the substituted text.
+  auto lit = begin(lines_);
+  std::advance(lit, firstLine);
+  std::string line;
+  std::string result;
+  unsigned int count = 0;
+  unsigned int lineIndex = firstLine;
+  auto lastChanged = end(lines_);
+  unsigned int lastChangedIndex = 0;
+
+  for (unsigned int remaining = lastLine - firstLine + 1; remaining > 0; --remaining, ++lit, ++lineIndex) {
+    line.assign(begin(*lit), end(*lit));
+    unsigned int replaced = substitution.apply(line, result);
+    if (replaced == 0) {
+      continue;
+    }
+    count += replaced;
+
+    // The replacement may contain line breaks, which split the line.
+    std::size_t start = 0;
+    std::size_t lineBreak = result.find('\n');
+    lit->assign(result.cbegin(), result.cbegin() + static_cast<std::ptrdiff_t>(
+      lineBreak == std::string::npos ? size(result) : lineBreak));
+    while (lineBreak != std::string::npos) {
+      start = lineBreak + 1;
+      lineBreak = result.find('\n', start);
+      auto pieceEnd = lineBreak == std::string::npos ? size(result) : lineBreak;
+      auto next = lit;
+      lit = lines_.emplace(++next, result.cbegin() + static_cast<std::ptrdiff_t>(start),
+        result.cbegin() + static_cast<std::ptrdiff_t>(pieceEnd));
+      ++lineIndex;
+    }
+    lastChanged = lit;
+    lastChangedIndex = lineIndex;
+  }
+
+  if (count != 0) {
+    modified_ = true;
+    setCursorPosition(positionAt(lastChanged, lastChangedIndex, 0));
+  }
+  return count;
+}
+
+bool Editor::save() {
+  // Write to a temporary file next to the target, then rename it over the
+  // target, so that the file is never left partially written.
+  std::filesystem::path target = path_;
+  std::error_code ec;
+  if (std::filesystem::is_symlink(target, ec)) {
+    target = std::filesystem::canonical(target, ec);
+  }
+  std::string tempName = target.string() + ".dvimXXXXXX";
+  int fd = mkstemp(tempName.data());
+  if (fd == -1) {
+    errorMessage_ = "Could not write " + path_.string() + ": " + std::strerror(errno);
+    mode = EditorMode::ERROR;
+    return false;
+  }
+
+  std::string buffer;
+  buffer.reserve(SAVE_BUFFER_SIZE);
+  bool ok = true;
+  auto flush = [&]() {
+    std::size_t written = 0;
+    while (ok && written < size(buffer)) {
+      ssize_t n = ::write(fd, buffer.data() + written, size(buffer) - written);
+      if (n == -1 && errno != EINTR) {
+        ok = false;
+      } else if (n > 0) {
+        written += static_cast<std::size_t>(n);
+      }
+    }
+    buffer.clear();
+  };
+  std::vector<std::uint64_t> hashes;
+  hashes.reserve(size(lines_));
+  for (const auto &line : lines_) {
+    hashes.push_back(hashLine(begin(line), end(line)));
+    buffer.append(begin(line), end(line));
+    buffer += '\n';
+    if (size(buffer) >= SAVE_BUFFER_SIZE) {
+      flush();
+    }
+  }
+  flush();
+
+  struct stat st;
+  mode_t permissions = (stat(target.c_str(), &st) == 0) ? (st.st_mode & 07777) : 0644;
+  ok = ok && fchmod(fd, permissions) == 0 && fsync(fd) == 0;
+  int savedErrno = errno;
+  ok = (close(fd) == 0) && ok;
+  if (ok && std::rename(tempName.c_str(), target.c_str()) != 0) {
+    savedErrno = errno;
+    ok = false;
+  }
+  if (!ok) {
+    unlink(tempName.c_str());
+    errorMessage_ = "Could not write " + path_.string() + ": " + std::strerror(savedErrno);
+    mode = EditorMode::ERROR;
+    return false;
+  }
+  modified_ = false;
+  changedOnDisk_ = false;
+  lineHashes_ = std::move(hashes);
+  recordDiskState();
+  return true;
+}
+
+bool Editor::isVisualMode() const {
+  return mode == EditorMode::VISUAL || mode == EditorMode::VISUAL_LINE ||
+    mode == EditorMode::VISUAL_BLOCK;
+}
+
+void Editor::enterVisualMode(EditorMode visualMode) {
+  if (!isVisualMode()) {
+    visualStartLine_ = cursorLine_;
+    visualStartColumn_ = cursorColumn_;
+    visualStartLineIterator_ = cursorLineIterator_;
+    visualStartColIterator_ = cursorColIterator_;
+  }
+  mode = visualMode;
+}
+
+std::pair<Editor::Position, Editor::Position> Editor::visualRange() {
+  // Returns the first and last selected positions, in buffer order.
+  Position start { visualStartLineIterator_, visualStartColIterator_,
+    visualStartLine_, visualStartColumn_ };
+  Position cursor = cursorPosition();
+  bool forward = (cursorLine_ == visualStartLine_) ?
+    (cursorColumn_ >= visualStartColumn_) :
+    (cursorLine_ > visualStartLine_);
+  return forward ? std::make_pair(start, cursor) : std::make_pair(cursor, start);
+}
+
+std::pair<unsigned int, unsigned int> Editor::visualBlockColumns() const {
+  // Returns the [first, last) columns selected in blockwise visual mode.
+  return { std::min(cursorColumn_, visualStartColumn_),
+    std::max(cursorColumn_, visualStartColumn_) + 1 };
+}
+
+void Editor::visualYank() {
+  auto [first, last] = visualRange();
+  std::string text;
+  if (mode == EditorMode::VISUAL) {
+    advancePosition(last);
+    text = textInRange(first, last);
+  } else if (mode == EditorMode::VISUAL_LINE) {
+    auto lit = first.line;
+    for (auto i = first.lineIndex; i <= last.lineIndex; ++i, ++lit) {
+      text.append(begin(*lit), end(*lit));
+      text += '\n';
+    }
+  } else {
+    auto [colBegin, colEnd] = visualBlockColumns();
+    auto lit = first.line;
+    for (auto i = first.lineIndex; i <= last.lineIndex; ++i, ++lit) {
+      if (i != first.lineIndex) {
+        text += '\n';
+      }
+      auto line = positionAt(lit, i, colBegin);
+      auto lineEnd = positionAt(lit, i, colEnd);
+      text.append(line.col, lineEnd.col);
+    }
+  }
+  registers_[activeRegister_] = text;
+}
+
+void Editor::visualDelete() {
+  auto [first, last] = visualRange();
+  modified_ = true;
+  if (mode == EditorMode::VISUAL) {
+    advancePosition(last);
+    mode = EditorMode::NORMAL;
+    deleteRange(first, last);
+  } else if (mode == EditorMode::VISUAL_LINE) {
+    // Remove all of the lines with a single splice.
+    auto lastLine = last.line;
+    ++lastLine;
+    std::list<std::list<char>> removed;
+    removed.splice(end(removed), lines_, first.line, lastLine);
+    std::string text;
+    for (const auto &line : removed) {
+      text.append(begin(line), end(line));
+      text += '\n';
+    }
+    registers_[activeRegister_] = text;
+
+    unsigned int lineIndex = first.lineIndex;
+    if (lines_.empty()) {
+      lines_.emplace_back();
+      lastLine = begin(lines_);
+    } else if (lastLine == end(lines_)) {
+      --lastLine;
+      --lineIndex;
+    }
+    mode = EditorMode::NORMAL;
+    setCursorPosition(positionAt(lastLine, lineIndex, 0));
+  } else {
+    visualYank();
+    auto [colBegin, colEnd] = visualBlockColumns();
+    auto lit = first.line;
+    for (auto i = first.lineIndex; i <= last.lineIndex; ++i, ++lit) {
+      auto line = positionAt(lit, i, colBegin);
+      auto lineEnd = positionAt(lit, i, colEnd);
+      lit->erase(line.col, lineEnd.col);
+    }
+    mode = EditorMode::NORMAL;
+    setCursorPosition(positionAt(first.line, first.lineIndex, colBegin));
+  }
+}
+
+void Editor::visualShift(bool right) {
+  auto [first, last] = visualRange();
+  modified_ = true;
+  auto lit = first.line;
+  for (auto i = first.lineIndex; i <= last.lineIndex; ++i, ++lit) {
+    if (right) {
+      if (!lit->empty()) {
+        lit->insert(begin(*lit), SHIFT_WIDTH, ' ');
+      }
+    } else {
+      auto indentEnd = begin(*lit);
+      for (unsigned int n = 0; n < SHIFT_WIDTH && indentEnd != end(*lit) &&
+        (*indentEnd == ' ' || *indentEnd == '\t'); ++n) {
+        ++indentEnd;
+      }
+      lit->erase(begin(*lit), indentEnd);
+    }
+  }
+  mode = EditorMode::NORMAL;
+  setCursorPosition(positionAt(first.line, first.lineIndex, 0));
+}
+
+void Editor::visualJoin() {
+  // Joins the selected lines (at least two) into the first one, replacing
+  // leading whitespace of the joined lines with a single space.
+  auto [first, last] = visualRange();
+  auto lastLine = last.line;
+  ++lastLine;
+  if (last.lineIndex == first.lineIndex && lastLine != end(lines_)) {
+    ++lastLine;
+  }
+  modified_ = true;
+  unsigned int joinColumn = 0;
+  auto lit = first.line;
+  for (++lit; lit != lastLine; ++lit) {
+    auto contentBegin = begin(*lit);
+    while (contentBegin != end(*lit) && (*contentBegin == ' ' || *contentBegin == '\t')) {
+      ++contentBegin;
+    }
+    joinColumn = static_cast<unsigned int>(size(*first.line));
+    if (!first.line->empty() && contentBegin != end(*lit) && *contentBegin != ')') {
+      first.line->push_back(' ');
+    }
+    first.line->splice(end(*first.line), *lit, contentBegin, end(*lit));
+  }
+  auto eraseBegin = first.line;
+  lines_.erase(++eraseBegin, lastLine);
+  mode = EditorMode::NORMAL;
+  setCursorPosition(positionAt(first.line, first.lineIndex, joinColumn));
+}
+
 void Editor::visualInput(char c) {
   switch (c) {
     case '\33':
       // ESC = exit visual mode
       mode = EditorMode::NORMAL;
       break;
+    case 'v':
+    case 'V':
+    case '\x16':
+      // Switch between visual modes, or exit if already in that mode
+      {
+        EditorMode visualMode = c == 'v' ? EditorMode::VISUAL :
+          (c == 'V' ? EditorMode::VISUAL_LINE : EditorMode::VISUAL_BLOCK);
+        mode = mode == visualMode ? EditorMode::NORMAL : visualMode;
+      }
+      break;
     case 'h':
       // Move left
       moveCursorLeft();
@@ -686,34 +1340,67 @@ void Editor::visualInput(char c) {
       // Move right
       moveCursorRight();
       break;
+    case 'w':
+    case 'W':
+      // Move to the beginning of the next word
+      setCursorPosition(nextWordStart(cursorPosition(), c == 'W'));
+      break;
+    case 'e':
+    case 'E':
+      // Move to the end of the next word
+      setCursorPosition(nextWordEnd(cursorPosition(), c == 'E'));
+      break;
+    case 'b':
+    case 'B':
+      // Move to the beginning of the previous word
+      setCursorPosition(prevWordStart(cursorPosition(), c == 'B'));
+      break;
     case 'y':
       // Copy selection
+      visualYank();
+      mode = EditorMode::NORMAL;
+      break;
+    case 'd':
+    case 'x':
+      // Delete selection
+      visualDelete();
+      break;
+    case 'c':
+      // Change selection
       {
-        std::string copyString;
-        bool forward = (cursorLine_ == visualStartLine_) ?
-          (cursorColumn_ > visualStartColumn_) :
-          (cursorLine_ > visualStartLine_);
-        auto lit = forward ? visualStartLineIterator_ : cursorLineIterator_;
-        auto cit = forward ? visualStartColIterator_ : cursorColIterator_;
-        auto elit = forward ? cursorLineIterator_ : visualStartLineIterator_;
-        auto ecit = forward ? cursorColIterator_ : visualStartColIterator_;
-
-        while (lit != elit) {
-          for (; cit != end(*lit); ++cit) {
-            copyString += *cit;
-          }
-          copyString += '\n';
-          ++lit;
-          cit = begin(*lit);
+        auto [first, last] = visualRange();
+        if (mode == EditorMode::VISUAL_LINE) {
+          // Replace the selected lines with a single empty line.
+          visualYank();
+          auto lastLine = last.line;
+          ++lastLine;
+          auto eraseBegin = first.line;
+          lines_.erase(++eraseBegin, lastLine);
+          first.line->clear();
+          modified_ = true;
+          mode = EditorMode::INSERT;
+          setCursorPosition(positionAt(first.line, first.lineIndex, 0));
+        } else {
+          unsigned int column = mode == EditorMode::VISUAL_BLOCK ?
+            visualBlockColumns().first : first.colIndex;
+          visualDelete();
+          mode = EditorMode::INSERT;
+          setCursorPosition(positionAt(cursorLineIterator_, cursorLine_, column));
         }
-        for (; cit != ecit; ++cit) {
-          copyString += *cit;
-        }
-        copyString += *cit;
-        registers_[activeRegister_] = copyString;
-        mode = EditorMode::NORMAL;
       }
       break;
+    case '>':
+      // Indent selected lines
+      visualShift(true);
+      break;
+    case '<':
+      // Unindent selected lines
+      visualShift(false);
+      break;
+    case 'J':
+      // Join selected lines
+      visualJoin();
+      break;
   }
 }
 
@@ -722,7 +1409,19 @@ void Editor::regWindowInput(char c) {
     case '\33':
       // ESC = exit register window
       mode = EditorMode::NORMAL;
-      manager_.removeWindow("registers");
+      manager_->removeWindow(registersWindow_);
+      break;
+    default:
+      break;
+  }
+}
+
+void Editor::perfWindowInput(char c) {
+  switch (c) {
+    case '\33':
+      // ESC = exit perf window
+      mode = EditorMode::NORMAL;
+      manager_->removeWindow(perfWindow_);
       break;
     default:
       break;
@@ -740,9 +1439,9 @@ std::vector<std::string> Editor::getUsageHints() const {
         "j - move down",
         "k - move up",
         "l - move right",
-        "w - beginning of next word",
-        "e - end of next word",
-        "b - beginning of previous word",
+        "w/W - beginning of next word/WORD",
+        "e/E - end of next word/WORD",
+        "b/B - beginning of previous word/WORD",
         "^ - go to beginning of line",
         "$ - go to end of line",
         "i - insert character",
@@ -751,6 +1450,8 @@ std::vector<std::string> Editor::getUsageHints() const {
         "O - add line above",
         ": - enter command mode",
         "v - enter visual mode",
+        "V - enter visual line mode",
+        "^V - enter visual block mode",
         "x - delete character",
         "p - paste contents of active register"
       };
@@ -765,21 +1466,35 @@ std::vector<std::string> Editor::getUsageHints() const {
         "w - save file",
         "q - quit editor",
         "reg show - show register contents",
-        "reg select <x> - select register x"
+        "reg select <x> - select register x",
+        "perf - show render counters"
       };
     case EditorMode::VISUAL:
+    case EditorMode::VISUAL_LINE:
+    case EditorMode::VISUAL_BLOCK:
       return {
         "ESC - exit visual mode",
         "h - move left",
         "j - move down",
         "k - move up",
         "l - move right",
-        "y - copy selection to active register"
+        "w/e/b - move by word",
+        "v/V/^V - switch visual mode",
+        "y - copy selection to active register",
+        "d - delete selection",
+        "c - change selection",
+        "> - indent lines",
+        "< - unindent lines",
+        "J - join lines"
       };
     case EditorMode::REGWINDOW:
       return {
         "ESC - exit register window"
       };
+    case EditorMode::PERFWINDOW:
+      return {
+        "ESC - exit perf window"
+      };
     case EditorMode::ERROR:
       return {
         "any key - exit error mode"
@@ -792,9 +1507,25 @@ std::vector<std::string> Editor::getLines(unsigned int width) {
   unsigned int textWidth = width - static_cast<unsigned int>(size(std::to_string(size(lines_)))) - 2;
   unsigned int paddingWidth = width - textWidth;
 
+  // Bounds of the visual selection, so that each character only needs to be
+  // compared against a span of columns.
+  bool isVisual = isVisualMode();
+  unsigned int firstLine = 0;
+  unsigned int lastLine = 0;
+  unsigned int firstColumn = 0;
+  unsigned int lastColumn = 0;
+  if (isVisual) {
+    auto [first, last] = visualRange();
+    firstLine = first.lineIndex;
+    lastLine = last.lineIndex;
+    firstColumn = first.colIndex;
+    lastColumn = last.colIndex + 1;
+    if (mode == EditorMode::VISUAL_BLOCK) {
+      std::tie(firstColumn, lastColumn) = visualBlockColumns();
+    }
+  }
+
   unsigned int lineNumber = 1;
-  bool isVisual = false;
-  bool overlap = (visualStartLineIterator_ == cursorLineIterator_ && visualStartColIterator_ == cursorColIterator_);
   std::vector<std::string> lines;
 
   unsigned int i = 0;
@@ -807,19 +1538,29 @@ std::vector<std::string> Editor::getLines(unsigned int width) {
     line = std::string(paddingWidth - static_cast<unsigned int>(size(std::to_string(lineNumber))) - 1, ' ') + line;
     ++lineNumber;
 
+    // Selected columns [spanBegin, spanEnd) on this line.
+    unsigned int spanBegin = 0;
+    unsigned int spanEnd = 0;
+    if (isVisual && i >= firstLine && i <= lastLine) {
+      spanEnd = static_cast<unsigned int>(size(*lit));
+      if (mode == EditorMode::VISUAL_BLOCK) {
+        spanBegin = firstColumn;
+        spanEnd = lastColumn;
+      } else if (mode == EditorMode::VISUAL) {
+        if (i == firstLine) spanBegin = firstColumn;
+        if (i == lastLine) spanEnd = lastColumn;
+      }
+    }
+    bool isCursorLine = lit == cursorLineIterator_;
+
     j = 0;
-    for (auto cit = begin(*lit); cit != end(*lit); ++cit) {
-      if (mode == VISUAL && lit == visualStartLineIterator_ && 
-        cit == visualStartColIterator_ && !overlap) {
-        line += "\33[48;5;243m" + std::string{*cit} + "\33[0m";
-        isVisual = !isVisual;
-      } else if (lit == cursorLineIterator_ && cit == cursorColIterator_) {
-        line += "\33[48;5;243m" + std::string{*cit} + "\33[0m";
+    unsigned int column = 0;
+    for (auto cit = begin(*lit); cit != end(*lit); ++cit, ++column) {
+      bool isCursor = isCursorLine && cit == cursorColIterator_;
+      if (isCursor) {
         cursorScroll_ = static_cast<unsigned int>(size(lines));
-        if (mode == VISUAL && !overlap) {
-          isVisual = !isVisual;
-        }
-      } else if (mode == VISUAL && isVisual) {
+      }
+      if (isCursor || (column >= spanBegin && column < spanEnd)) {
         line += "\33[48;5;243m" + std::string{*cit} + "\33[0m";
       } else {
         line += *cit;
@@ -831,7 +1572,7 @@ std::vector<std::string> Editor::getLines(unsigned int width) {
         line = std::string(paddingWidth, ' ');
       }
     }
-    if (cursorColIterator_ == end(*lit) && lit == cursorLineIterator_) {
+    if (cursorColIterator_ == end(*lit) && isCursorLine) {
       line += "\33[48;5;243m \33[0m";
       cursorScroll_ = static_cast<unsigned int>(size(lines));
     }
@@ -3,14 +3,20 @@
 // Object for representing an editor.
 
 #include <array>
+#include <cstdint>
 #include <filesystem>
 #include <list>
 #include <string>
 #include <vector>
 
+#include <regex>
+
 #include "dcurses/WindowManager.hpp"
+#include "Substitution.hpp"
 
 #define NUM_REGS 10
+#define SAVE_BUFFER_SIZE (1 << 16)
+#define SHIFT_WIDTH 2
 
 #ifndef DVIM_EDITOR_HPP_
 #define DVIM_EDITOR_HPP_
@@ -24,6 +30,17 @@ class Editor {
    */
   Editor(const std::filesystem::path &path, dcurses::WindowManager &manager);
 
+  /*
+   * Initialize the editor with the specified file path, without a window
+   * manager. Commands that open windows are unavailable.
+   */
+  explicit Editor(const std::filesystem::path &path);
+
+  /*
+   * Sets the window that the editor is displayed in. Popups are placed relative to it.
+   */
+  void setWindow(dcurses::WindowHandle window) { window_ = window; }
+
   /*
    * Handle a single character input action.
    */
@@ -69,6 +86,31 @@ class Editor {
    */
   std::string getErrorMessage() const { return errorMessage_; }
 
+  /*
+   * Returns whether the buffer has been modified since it was last saved.
+   */
+  bool isModified() const { return modified_; }
+
+  /*
+   * Writes the buffer to the file. The file is replaced atomically, so that it
+   * is never left partially written.
+   * @return true if the file was written, false otherwise. On failure, the
+   * editor switches to ERROR mode with the reason.
+   */
+  bool save();
+
+  /*
+   * Handles the file being changed by another process. If the buffer has no
+   * unsaved changes, only the lines that changed are reloaded. Otherwise, the
+   * editor reports the conflict, and :w refuses to overwrite the file.
+   */
+  void handleExternalChange();
+
+  /*
+   * Returns the path of the file being edited.
+   */
+  const std::filesystem::path &getPath() const { return path_; }
+
   /*
    * Returns the current mode.
    */
@@ -86,8 +128,14 @@ class Editor {
         return "COMMAND";
       case EditorMode::VISUAL:
         return "VISUAL";
+      case EditorMode::VISUAL_LINE:
+        return "VISUAL LINE";
+      case EditorMode::VISUAL_BLOCK:
+        return "VISUAL BLOCK";
       case EditorMode::REGWINDOW:
         return "REG SHOW";
+      case EditorMode::PERFWINDOW:
+        return "PERF";
       default:
         return "UNKNOWN";
     }
@@ -101,7 +149,10 @@ class Editor {
     INSERT,
     COMMAND,
     VISUAL,
-    REGWINDOW
+    VISUAL_LINE,
+    VISUAL_BLOCK,
+    REGWINDOW,
+    PERFWINDOW
   };
 
   void normalInput(char c);
@@ -109,6 +160,18 @@ class Editor {
   void commandInput(char c);
   void visualInput(char c);
   void regWindowInput(char c);
+  void perfWindowInput(char c);
+
+  /*
+   * A position in the buffer. A column iterator at the end of its line refers
+   * to the line break, which lets motions step across lines.
+   */
+  struct Position {
+    std::list<std::list<char>>::iterator line;
+    std::list<char>::iterator col;
+    unsigned int lineIndex;
+    unsigned int colIndex;
+  };
 
   // Common movement
   void moveCursorLeft();
@@ -116,25 +179,66 @@ class Editor {
   void moveCursorUp();
   void moveCursorDown();
 
+  // Word motions
+  Position cursorPosition();
+  void setCursorPosition(const Position &position);
+  bool advancePosition(Position &position);
+  bool retreatPosition(Position &position);
+  unsigned char classAt(const Position &position, bool bigWord) const;
+  Position nextWordStart(Position position, bool bigWord);
+  Position nextWordEnd(Position position, bool bigWord);
+  Position prevWordStart(Position position, bool bigWord);
+  void deleteRange(Position from, Position to);
+  std::string textInRange(Position from, Position to) const;
+  Position positionAt(std::list<std::list<char>>::iterator line,
+                      unsigned int lineIndex, unsigned int colIndex);
+
+  // Visual mode
+  bool isVisualMode() const;
+  void enterVisualMode(EditorMode visualMode);
+  std::pair<Position, Position> visualRange();
+  std::pair<unsigned int, unsigned int> visualBlockColumns() const;
+  void visualYank();
+  void visualDelete();
+  void visualShift(bool right);
+  void visualJoin();
+
   bool isSingleNavigationAction(char c);
   bool isSingleInPlaceEditAction(char c);
   bool isQueueableNormalAction(char c);
   void executeNormalAction(char c);
   void executeDeleteAction(char c);
   void executeCommand();
+  bool loadFile(bool incremental);
+  void recordDiskState();
+  bool diskStateChanged() const;
+  void executeSubstitute(const std::smatch &command);
+  unsigned int substitute(unsigned int firstLine, unsigned int lastLine,
+                          const Substitution &substitution);
 
   EditorMode mode = EditorMode::NORMAL;
 
-  dcurses::WindowManager &manager_;
+  dcurses::WindowManager *manager_ = nullptr;
+  dcurses::WindowHandle window_;
+  dcurses::WindowHandle registersWindow_;
+  dcurses::WindowHandle perfWindow_;
 
   std::filesystem::path path_;
   std::list<std::list<char>> lines_;
+  bool modified_ = false;
+
+  // Hashes of each line as last read from or written to disk. Only valid
+  // while the buffer is not modified.
+  std::vector<std::uint64_t> lineHashes_;
+  bool changedOnDisk_ = false;
+  std::filesystem::file_time_type diskTime_;
+  std::uintmax_t diskSize_ = 0;
   unsigned int cursorLine_ = 0;
   unsigned int cursorColumn_ = 0;
   unsigned int cursorScroll_ = 0;
 
   // Invariants:
-  // If NORMAL, COMMAND, or VISUAL mode:
+  // If NORMAL, COMMAND, or a VISUAL mode:
   // - cursorLineIterator_ refers to the line that the cursor is on.
   //   cursorLineIterator_ may be an end iterator if and only if there are no lines.
   // - cursorColIterator_ refers to the column that the cursor is on.
@@ -13,21 +13,34 @@
 #include "dcurses/WindowManager.hpp"
 #include "dvim.hpp"
 #include "Editor.hpp"
+#include "FileWatcher.hpp"
 
 namespace dvim {
 
+namespace {
+
+std::filesystem::path parentDirectory(const std::filesystem::path &path) {
+  auto parent = path.parent_path();
+  return parent.empty() ? std::filesystem::path{"."} : parent;
+}
+
+}  // namespace
+
 EditorView::EditorView(const std::filesystem::path &path, 
-  dcurses::WindowManager &manager, dvim::dvimController& controller) 
-  : windowManager_(manager), controller_(controller), editor_(path, manager), path_(path) {
-  manager.addWindow("editor", {0, 30, manager.getWidth() - 30, manager.getHeight() - 10, 0, DOUBLE_BORDER});
-  window_ = manager["editor"];
-  manager.addWindow("command", {manager.getHeight() - 1, 0, manager.getWidth(), 1, 0, NO_BORDER});
-  commandWindow_ = manager["command"];
+  dcurses::WindowManager &manager, dvim::dvimController& controller, FileWatcher &watcher) 
+  : windowManager_(manager), controller_(controller), editor_(path, manager),
+    watcher_(watcher), path_(path) {
+  watcher_.watch(parentDirectory(path_));
+  using dcurses::Extent;
+  window_ = manager.addWindow({0, 30, Extent::fromEnd(-30), Extent::fromEnd(-10), 0, DOUBLE_BORDER});
+  commandWindow_ = manager.addWindow({Extent::fromEnd(-1), 0, Extent::fromEnd(0), 1, 0, NO_BORDER});
+  editor_.setWindow(window_);
 }
 
 EditorView::~EditorView() {
-  windowManager_.removeWindow("editor");
-  windowManager_.removeWindow("command");
+  watcher_.unwatch(parentDirectory(path_));
+  windowManager_.removeWindow(window_);
+  windowManager_.removeWindow(commandWindow_);
 }
 
 void EditorView::handleInput(char ch) {
@@ -37,37 +50,52 @@ void EditorView::handleInput(char ch) {
   }
 }
 
+void EditorView::handleFileChanges(const std::vector<std::filesystem::path> &paths) {
+  // The parent directory itself is reported when it moves or when events were lost.
+  auto path = path_.lexically_normal();
+  auto directory = parentDirectory(path_).lexically_normal();
+  for (const auto &changed : paths) {
+    auto normal = changed.lexically_normal();
+    if (normal == path || normal == directory) {
+      editor_.handleExternalChange();
+      return;
+    }
+  }
+}
+
 void EditorView::refresh() {
-  window_->clear();
-  auto str = editor_.getLines(window_->width());
+  auto &window = windowManager_[window_];
+  window.clear();
+  auto str = editor_.getLines(window.width());
 
   std::string title = " " + path_.filename().string() + " [" + editor_.getMode() + "] ";
-  window_->setString(0, 2, title);
-  window_->setString(window_->height() - 1, 2, " R" + std::to_string(editor_.getCursorLine()) + ":C" + std::to_string(editor_.getCursorColumn()) + " ");
+  window.setString(0, 2, title);
+  window.setString(window.height() - 1, 2, " R" + std::to_string(editor_.getCursorLine()) + ":C" + std::to_string(editor_.getCursorColumn()) + " ");
   
   // Check scroll bounds
   if (editor_.getCursorScroll() < scroll_) {
     scroll_ = editor_.getCursorScroll();
-  } else if (editor_.getCursorScroll() >= scroll_ + window_->height() - 2) {
-    scroll_ = editor_.getCursorScroll() - (window_->height() - 2) + 1;
+  } else if (editor_.getCursorScroll() >= scroll_ + window.height() - 2) {
+    scroll_ = editor_.getCursorScroll() - (window.height() - 2) + 1;
   }
 
   // Draw lines
-  for (unsigned int i = 1; i < window_->height() - 1; i++) {
+  for (unsigned int i = 1; i < window.height() - 1; i++) {
     if (i - 1 + scroll_ >= size(str)) break;
     auto line = str[i - 1 + scroll_];
     unsigned int col = 2;
-    window_->setString(i, col, line);
+    window.setString(i, col, line);
   }
 
   // Display command if necessary
-  commandWindow_->clear();
+  auto &commandWindow = windowManager_[commandWindow_];
+  commandWindow.clear();
   if (editor_.getMode() == "NORMAL") {
-    commandWindow_->setString(0, 0, "\33[1m" + editor_.getQueuedActions() + "\33[0m");
+    commandWindow.setString(0, 0, "\33[1m" + editor_.getQueuedActions() + "\33[0m");
   } else if (editor_.getMode() == "COMMAND") {
-    commandWindow_->setString(0, 0, "\33[1m:" + editor_.getCommandContents() + "\33[0m");
+    commandWindow.setString(0, 0, "\33[1m:" + editor_.getCommandContents() + "\33[0m");
   } else if (editor_.getMode() == "ERROR") {
-    commandWindow_->setString(0, 0, "\33[1m\33[1;31m" + editor_.getErrorMessage() + "\33[0m");
+    commandWindow.setString(0, 0, "\33[1m\33[1;31m" + editor_.getErrorMessage() + "\33[0m");
   }
 }
 
@@ -13,6 +13,7 @@
 #include "dcurses/Window.hpp"
 #include "dcurses/WindowManager.hpp"
 #include "Editor.hpp"
+#include "FileWatcher.hpp"
 
 namespace dvim {
 
@@ -29,7 +30,7 @@ class EditorView {
    * provided path.
    */
   EditorView(const std::filesystem::path &path, dcurses::WindowManager &manager,
-             dvim::dvimController& controller);
+             dvim::dvimController& controller, FileWatcher &watcher);
 
   /*
    * Destroys the editor view, and removes the corresponding window.
@@ -51,12 +52,19 @@ class EditorView {
    */
   void refresh();
 
+  /*
+   * Handles files changed by other processes, reloading the file being
+   * edited if it is one of them.
+   */
+  void handleFileChanges(const std::vector<std::filesystem::path> &paths);
+
  private:
   dcurses::WindowManager &windowManager_;
-  std::shared_ptr<dcurses::Window> window_;
-  std::shared_ptr<dcurses::Window> commandWindow_;
+  dcurses::WindowHandle window_;
+  dcurses::WindowHandle commandWindow_;
   dvim::dvimController& controller_;
   Editor editor_;
+  FileWatcher &watcher_;
 
   std::filesystem::path path_;
   unsigned int scroll_ = 0;
@@ -4,8 +4,11 @@
 
 #include "FileTree.hpp"
 
+#include <algorithm>
 #include <filesystem>
+#include <map>
 #include <set>
+#include <system_error>
 #include <string>
 #include <vector>
 
@@ -56,67 +59,116 @@ std::string ext2icon(const std::filesystem::path &path) {
 #endif
 }
 
-FileTree::FileTree(const std::filesystem::path &path) : path_(path) {}
+FileTree::FileTree(const std::filesystem::path &path, FileWatcher *watcher) :
+  root_{path, true}, lines_{{&root_, 0, false}}, watcher_(watcher) {}
 
-void FileTree::open(std::filesystem::path path) {
-  openPaths_.insert(path);
+void FileTree::open(unsigned int line) {
+  if (line >= size(lines_) || lines_[line].open || !lines_[line].entry->directory) return;
+  const Entry &directory = *lines_[line].entry;
+  openPaths_.insert(directory.path);
+  if (watcher_) watcher_->watch(directory.path);
+  lines_[line].open = true;
+
+  std::vector<Line> subtree;
+  appendSubtree(directory, lines_[line].depth + 1, subtree);
+  lines_.insert(begin(lines_) + line + 1, begin(subtree), end(subtree));
 }
 
-void FileTree::close(std::filesystem::path path) {
-  openPaths_.erase(path);
+void FileTree::close(unsigned int line) {
+  if (line >= size(lines_) || !lines_[line].open) return;
+  const Entry &directory = *lines_[line].entry;
+  openPaths_.erase(directory.path);
+  if (watcher_) watcher_->unwatch(directory.path);
+  lines_[line].open = false;
+
+  // The lines below the directory that are deeper than it are its subtree.
+  auto first = begin(lines_) + line + 1;
+  auto last = std::find_if(first, end(lines_),
+                           [depth = lines_[line].depth](const Line &l) { return l.depth <= depth; });
+  lines_.erase(first, last);
+  // The directory is no longer watched, so its entries could go out of date.
+  entries_.erase(directory.path.lexically_normal());
 }
 
-void FileTree::toggle(std::filesystem::path path) {
-  if (openPaths_.count(path)) {
-    close(path);
+void FileTree::toggle(unsigned int line) {
+  if (line >= size(lines_)) return;
+  if (lines_[line].open) {
+    close(line);
   } else {
-    open(path);
+    open(line);
   }
 }
 
-std::vector<std::string> FileTree::toString() {
-  auto res = stringifyPath(path_);
-  line2path_ = {};
-  std::vector<std::string> result;
-  for (auto &p : res) {
-    result.emplace_back(p.first);
-    line2path_.push_back(p.second);
+void FileTree::handleFileChanges(const std::vector<std::filesystem::path> &changes) {
+  if (watcher_ && watcher_->overflowed()) {
+    // Changes were lost, so no cached directory can be trusted.
+    entries_.clear();
+    rebuild();
+    return;
   }
-  return result;
+  bool changed = false;
+  for (const auto &path : changes) {
+    // A change is reported as <directory>/<name>, or as the directory itself when it is
+    // deleted or moved. Cached directories are keyed by their normalized paths, as the
+    // watcher's are.
+    if (entries_.erase(path.lexically_normal()) + entries_.erase(path.parent_path().lexically_normal()) != 0) {
+      changed = true;
+    }
+  }
+  // Lines may point into the dropped entries.
+  if (changed) rebuild();
+}
+
+const std::vector<FileTree::Entry> &FileTree::entries(const std::filesystem::path &directory) {
+  auto key = directory.lexically_normal();
+  auto it = entries_.find(key);
+  if (it != end(entries_)) return it->second;
+
+  std::vector<Entry> result;
+  std::error_code error;
+  for (std::filesystem::directory_iterator entry {directory, error}, last; !error && entry != last;
+       entry.increment(error)) {
+    std::error_code typeError;
+    result.push_back({entry->path(), entry->is_directory(typeError)});
+  }
+  return entries_.emplace(std::move(key), std::move(result)).first->second;
 }
 
-std::vector<std::pair<std::string, std::filesystem::path>> FileTree::stringifyPath(const std::filesystem::path &path) const {
-  if (!openPaths_.count(path)) {
-    return {{CLOSEDFOLDER + " " + path.filename().string(), path}};
+void FileTree::appendSubtree(const Entry &directory, unsigned int depth, std::vector<Line> &lines) {
+  for (const Entry &entry : entries(directory.path)) {
+    bool open = entry.directory && openPaths_.count(entry.path);
+    lines.push_back({&entry, depth, open});
+    if (open) appendSubtree(entry, depth + 1, lines);
   }
-  std::vector<std::pair<std::string, std::filesystem::path>> result 
-    = {{OPENFOLDER + " " + path.filename().string(), path}};
-  
-  int i = 0;
-  for ([[maybe_unused]] const auto &entry : std::filesystem::directory_iterator(path)) {
-    ++i;
+}
+
+void FileTree::rebuild() {
+  bool open = openPaths_.count(root_.path);
+  lines_.clear();
+  lines_.push_back({&root_, 0, open});
+  if (open) appendSubtree(root_, 1, lines_);
+}
+
+std::string FileTree::lineToString(unsigned int line) const {
+  if (line >= size(lines_)) return "";
+  const Line &l = lines_[line];
+
+  // The leader for each level of nesting is a bottom corner if the line is the
+  // last one in its subtree at that level, that is, if the next line is
+  // shallower than that level.
+  unsigned int nextDepth = line + 1 < size(lines_) ? lines_[line + 1].depth : 0;
+  std::string result;
+  for (unsigned int level = 1; level <= l.depth; ++level) {
+    result += nextDepth < level ? LEADERBOTTOM : LEADER;
+    result += " ";
   }
-  for (const auto &entry : std::filesystem::directory_iterator(path)) {
-    --i;
-    auto leader = (i == 0 ? LEADERBOTTOM : LEADER);
-    if (entry.is_directory()) {
-      auto sub = stringifyPath(entry.path());
-      for (unsigned int j = 0; j < size(sub); ++j) {
-        auto l = sub[j];
-        if (j == size(sub) - 1) {
-          result.emplace_back(std::make_pair(leader + " " + l.first, l.second));
-        } else {
-          result.emplace_back(std::make_pair(LEADER + " " + l.first, l.second));
-        }
-      }
-    } else {
-      std::string entryStr = leader + " ";
-      entryStr += ext2icon(entry.path());
-      entryStr += " ";
-      entryStr += entry.path().filename().string();
-      result.emplace_back(std::make_pair(entryStr, entry.path()));
-    }
+  if (l.entry->directory) {
+    result += l.open ? OPENFOLDER : CLOSEDFOLDER;
+  } else {
+    result += ext2icon(l.entry->path);
   }
+  result += " ";
+  result += l.entry->path.filename().string();
   return result;
 }
 
@@ -6,10 +6,13 @@
 #define DVIM_FILE_TREE_HPP_
 
 #include <filesystem>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "FileWatcher.hpp"
+
 namespace dvim {
 
 /*
@@ -22,47 +25,96 @@ class FileTree {
  public:
   /*
    * Constructs the file tree object, which represents the given path and all of
-   * its subpaths.
+   * its subpaths. Open directories are watched for changes if a watcher is
+   * provided.
+   *
+   * The entries of each open directory are read once and cached until
+   * handleFileChanges reports a change in the directory, so rendering the tree
+   * does no file system I/O. The visible entries are kept as a flat array of
+   * lines, which is updated in place when a directory is opened or closed.
+   */
+  explicit FileTree(const std::filesystem::path &path, FileWatcher *watcher = nullptr);
+
+  /*
+   * Opens the directory on the specified line, allowing subpaths to be viewed.
    */
-  explicit FileTree(const std::filesystem::path &path);
+  void open(unsigned int line);
 
   /*
-   * Opens the specified path, allowing subpaths to be viewed.
+   * Closes the directory on the specified line, stopping subpaths from being
+   * viewed.
    */
-  void open(std::filesystem::path path);
+  void close(unsigned int line);
 
   /*
-   * Closes the specified path, stopping subpaths from being viewed.
+   * Toggles the visibility of the subpaths of the directory on the specified
+   * line. Does nothing for files.
    */
-  void close(std::filesystem::path path);
+  void toggle(unsigned int line);
 
   /*
-   * Toggles the visibility of the specified path.
+   * Drops the cached entries of the directories containing the changed paths,
+   * and reads them again. If the watcher lost events, every cached directory
+   * is read again.
+   * @param changes Paths reported by the FileWatcher.
    */
-  void toggle(std::filesystem::path path);
+  void handleFileChanges(const std::vector<std::filesystem::path> &changes);
 
   /*
-   * Generates a list of lines, each corresponding to a file or directory in the
-   * current path.
+   * Returns the number of visible lines.
    */
-  std::vector<std::string> toString();
+  unsigned int lineCount() const { return static_cast<unsigned int>(size(lines_)); }
 
   /*
-   * Retrieves the path corresponding to the specified line in the most recent
-   * output of toString.
+   * Generates the text of the specified line: its leaders, icon and name.
+   * Lines are generated on demand, so only the lines drawn cost anything.
+   */
+  std::string lineToString(unsigned int line) const;
+
+  /*
+   * Retrieves the path corresponding to the specified line.
    */
   std::filesystem::path lineToPath(unsigned int line) const {
-    if (line < 0 || line >= size(line2path_)) return ".";
-    return line2path_[line]; 
+    if (line >= size(lines_)) return ".";
+    return lines_[line].entry->path;
   }
 
  private:
-  std::vector<std::pair<std::string, std::filesystem::path>> stringifyPath(const std::filesystem::path &path) const;
+  struct Entry {
+    std::filesystem::path path;
+    bool directory;
+  };
+
+  // A visible line. Entries are owned by entries_ (or root_), and stay in
+  // place until their directory's cached entries are dropped.
+  struct Line {
+    const Entry *entry;
+    unsigned int depth;
+    bool open;
+  };
+
+  /*
+   * Returns the entries of a directory, reading them if they are not cached.
+   */
+  const std::vector<Entry> &entries(const std::filesystem::path &directory);
+
+  /*
+   * Appends the lines for the subpaths of an open directory, including those of
+   * the open directories within it.
+   */
+  void appendSubtree(const Entry &directory, unsigned int depth, std::vector<Line> &lines);
+
+  /*
+   * Generates every visible line again, from the root.
+   */
+  void rebuild();
 
-  std::vector<std::filesystem::path> line2path_;
+  Entry root_;
+  std::vector<Line> lines_;
+  std::map<std::filesystem::path, std::vector<Entry>> entries_;
 
-  std::filesystem::path path_;
   std::set<std::filesystem::path> openPaths_;
+  FileWatcher *watcher_;
 };
 
 }  // namespace dvim
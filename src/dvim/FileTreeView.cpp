@@ -7,60 +7,98 @@
 #include <filesystem>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "dcurses/Style.hpp"
+#include "dcurses/TextCells.hpp"
 #include "dcurses/Window.hpp"
 #include "FileTree.hpp"
-#include "Utilities.hpp"
+#include "FileWatcher.hpp"
 
 namespace dvim {
 
-FileTreeView::FileTreeView(const std::filesystem::path &path, dcurses::WindowManager &manager) : 
-  windowManager_(manager), fileTree_(path) {
-  manager.addWindow("fileTree", {0, 0, 30, manager.getHeight() - 10, 1, DEFAULT_BORDER});
-  window_ = manager["fileTree"];
-  heightAvailable_ = window_->height() - 2;
+namespace {
+
+/*
+ * Gives every cell of a line the cursor's background, keeping the cells' other styles.
+ */
+std::string highlightLine(std::string_view line) {
+  std::string highlighted;
+  dcurses::Style current;
+  for (const dcurses::TextCell &cell : dcurses::TextCells{line}) {
+    dcurses::Style style = cell.style;
+    style.background = dcurses::Style::INDEXED_COLOR | 243;
+    if (style != current || highlighted.empty()) {
+      char parameters[SGR_BUFFER_SIZE];
+      highlighted += "\33[";
+      highlighted.append(parameters, dcurses::encodeSgrTransition(current, style, parameters));
+      highlighted += 'm';
+      current = style;
+    }
+    highlighted += cell.text;
+  }
+  return highlighted;
+}
+
+}  // namespace
+
+FileTreeView::FileTreeView(const std::filesystem::path &path, dcurses::WindowManager &manager,
+  FileWatcher &watcher) : windowManager_(manager), fileTree_(path, &watcher) {
+  window_ = manager.addWindow({0, 0, 30, dcurses::Extent::fromEnd(-10), 1, DEFAULT_BORDER});
 }
 
 FileTreeView::~FileTreeView() {
-  windowManager_.removeWindow("fileTree");
+  windowManager_.removeWindow(window_);
 }
 
 void FileTreeView::handleInput(char ch) {
   if (ch == 'j') {
-    if (cursor_ < size(fileTree_.toString()) - 1) {
+    if (cursor_ + 1 < fileTree_.lineCount()) {
       cursor_++;
-      if (cursor_ >= scroll_ + heightAvailable_) {
-        scroll_++;
-      }
     }
   } else if (ch == 'k') {
     if (cursor_ > 0) {
       cursor_--;
-      if (cursor_ < scroll_) {
-        scroll_--;
-      }
     }
   } else if (ch == ' ') {
-    fileTree_.toggle(fileTree_.lineToPath(cursor_));
+    fileTree_.toggle(cursor_);
+  }
+}
+
+void FileTreeView::handleFileChanges(const std::vector<std::filesystem::path> &changes) {
+  fileTree_.handleFileChanges(changes);
+  // Entries may have been removed from under the cursor.
+  unsigned int lines = fileTree_.lineCount();
+  if (cursor_ >= lines) {
+    cursor_ = lines > 0 ? lines - 1 : 0;
   }
 }
 
 void FileTreeView::refresh() {
-  window_->clear();
+  auto &window = windowManager_[window_];
+  window.clear();
+
+  // Keep the cursor in view. The window's height changes when the terminal is resized.
+  unsigned int heightAvailable = window.height() > 2 ? window.height() - 2 : 0;
+  if (cursor_ < scroll_) {
+    scroll_ = cursor_;
+  } else if (heightAvailable > 0 && cursor_ >= scroll_ + heightAvailable) {
+    scroll_ = cursor_ - heightAvailable + 1;
+  }
+
+  // Only the lines in view are generated. Lines are cut off two columns before the right
+  // border. The cursor's line is highlighted without losing the colors of its icons.
+  unsigned int maxWidth = window.width() > 4 ? window.width() - 4 : 0;
   unsigned int row = 1;
-  auto str = fileTree_.toString();
-  for (unsigned int i = 0; i < heightAvailable_; i++) {
-    if (i >= size(str)) break;
-    auto line = str[i + scroll_];
-    unsigned int col = 2;
-    for (auto c : dvim::splitVisibleCharacters(line)) {
-      if (i + scroll_ == cursor_ ) {
-        window_->setString(row, col, std::string{"\033[48;5;243m"} + c + std::string{"\033[0m"});
-      } else {
-        window_->setString(row, col, c);
-      }
-      col++;
-      if (col == 28) break;
+  for (unsigned int i = 0; i < heightAvailable; i++) {
+    if (i + scroll_ >= fileTree_.lineCount()) break;
+    std::string text = fileTree_.lineToString(i + scroll_);
+    std::string_view line = dcurses::truncateToWidth(text, maxWidth);
+    if (i + scroll_ == cursor_) {
+      window.setString(row, 2, highlightLine(line));
+    } else {
+      window.setString(row, 2, line);
     }
     row++;
   }
@@ -7,10 +7,12 @@
 
 #include <filesystem>
 #include <memory>
+#include <vector>
 
 #include "dcurses/Window.hpp"
 #include "dcurses/WindowManager.hpp"
 #include "FileTree.hpp"
+#include "FileWatcher.hpp"
 
 namespace dvim {
 
@@ -22,7 +24,8 @@ class FileTreeView {
   /*
    * Constructs the file tree view in the specified window manager.
    */
-  FileTreeView(const std::filesystem::path &path, dcurses::WindowManager &manager);
+  FileTreeView(const std::filesystem::path &path, dcurses::WindowManager &manager,
+               FileWatcher &watcher);
 
   /*
    * Destroys the file tree view, and removes the corresponding window.
@@ -34,6 +37,12 @@ class FileTreeView {
    */
   void handleInput(char ch);
 
+  /*
+   * Updates the tree after files changed on disk.
+   * @param changes Paths reported by the FileWatcher.
+   */
+  void handleFileChanges(const std::vector<std::filesystem::path> &changes);
+
   /*
    * Refreshes the file tree view, to update the contents.
    */
@@ -46,12 +55,11 @@ class FileTreeView {
 
  private:
   dcurses::WindowManager &windowManager_;
-  std::shared_ptr<dcurses::Window> window_;
+  dcurses::WindowHandle window_;
   FileTree fileTree_;
 
   unsigned int cursor_ = 0;
   unsigned int scroll_ = 0;
-  unsigned int heightAvailable_ = 0;
 };
 
 }
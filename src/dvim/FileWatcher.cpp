@@ -0,0 +1,108 @@
+// Copyright 2022 Daniel Liu
+
+// Watches directories for changes made by other processes.
+
+#include "FileWatcher.hpp"
+
+#include <filesystem>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define WATCH_BUFFER_SIZE 4096
+
+namespace dvim {
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+  if (fd_ != -1) {
+    close(fd_);
+  }
+#endif
+}
+
+void FileWatcher::watch(const std::filesystem::path &directory) {
+  auto path = directory.lexically_normal();
+  auto it = watches_.find(path);
+  if (it != watches_.end()) {
+    ++it->second.references;
+    return;
+  }
+  int descriptor = -1;
+#ifdef __linux__
+  if (fd_ != -1) {
+    descriptor = inotify_add_watch(fd_, path.c_str(),
+      IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+  }
+#endif
+  watches_[path] = {descriptor, 1};
+  if (descriptor != -1) {
+    directories_[descriptor] = path;
+  }
+}
+
+void FileWatcher::unwatch(const std::filesystem::path &directory) {
+  auto it = watches_.find(directory.lexically_normal());
+  if (it == watches_.end() || --it->second.references > 0) {
+    return;
+  }
+#ifdef __linux__
+  if (it->second.descriptor != -1) {
+    inotify_rm_watch(fd_, it->second.descriptor);
+    directories_.erase(it->second.descriptor);
+  }
+#endif
+  watches_.erase(it);
+}
+
+std::vector<std::filesystem::path> FileWatcher::readChanges() {
+  std::vector<std::filesystem::path> changes;
+  overflowed_ = false;
+#ifdef __linux__
+  if (fd_ == -1) {
+    return changes;
+  }
+  alignas(struct inotify_event) char buffer[WATCH_BUFFER_SIZE];
+  while (true) {
+    ssize_t length = read(fd_, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break;
+    }
+    for (char *ptr = buffer; ptr < buffer + length;) {
+      auto *event = reinterpret_cast<struct inotify_event *>(ptr);
+      ptr += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were lost, so any watched directory may have changed.
+        overflowed_ = true;
+        for (const auto &[directory, watch] : watches_) {
+          changes.push_back(directory);
+        }
+        continue;
+      }
+      auto it = directories_.find(event->wd);
+      if (it == directories_.end()) {
+        continue;
+      }
+      if (event->len > 0) {
+        changes.push_back((it->second / event->name).lexically_normal());
+      } else {
+        changes.push_back(it->second);
+      }
+    }
+  }
+#endif
+  return changes;
+}
+
+}  // namespace dvim
@@ -0,0 +1,74 @@
+// Copyright 2022 Daniel Liu
+
+// Watches directories for changes made by other processes.
+
+#ifndef DVIM_FILE_WATCHER_HPP_
+#define DVIM_FILE_WATCHER_HPP_
+
+#include <filesystem>
+#include <map>
+#include <vector>
+
+namespace dvim {
+
+/*
+ * Watches directories for files being created, modified, moved, or deleted,
+ * using inotify. Changes are read from a file descriptor, so that they can be
+ * waited on alongside terminal input. On platforms without inotify, nothing
+ * is watched and no changes are reported.
+ */
+class FileWatcher {
+ public:
+  FileWatcher();
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher &other) = delete;
+  FileWatcher &operator=(const FileWatcher &other) = delete;
+
+  /*
+   * Starts watching a directory. Directories are reference counted, so each
+   * call must be matched by a call to unwatch.
+   */
+  void watch(const std::filesystem::path &directory);
+
+  /*
+   * Stops watching a directory.
+   */
+  void unwatch(const std::filesystem::path &directory);
+
+  /*
+   * Returns the file descriptor that becomes readable when changes are
+   * available, or -1 if changes are never reported.
+   */
+  int fd() const { return fd_; }
+
+  /*
+   * Reads all pending changes, without blocking.
+   * @return The paths that changed, in the form <watched directory>/<name>,
+   * lexically normalized (so a file in "." is reported as "name"). A change
+   * to a watched directory itself is reported as the directory. If the
+   * kernel's event queue overflowed, every watched directory is reported.
+   */
+  std::vector<std::filesystem::path> readChanges();
+
+  /*
+   * Returns whether the last call to readChanges found that events were lost
+   * because the kernel's event queue overflowed.
+   */
+  bool overflowed() const { return overflowed_; }
+
+ private:
+  struct Watch {
+    int descriptor;
+    unsigned int references;
+  };
+
+  int fd_ = -1;
+  bool overflowed_ = false;
+  std::map<std::filesystem::path, Watch> watches_;
+  std::map<int, std::filesystem::path> directories_;  // descriptor -> path
+};
+
+}  // namespace dvim
+
+#endif
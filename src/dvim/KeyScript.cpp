@@ -0,0 +1,77 @@
+// Copyright 2022 Daniel Liu
+
+// Keystroke scripts.
+
+#include "KeyScript.hpp"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+namespace dvim {
+
+namespace {
+
+// Returns the key for a name between angle brackets, or -1 if the name is not
+// recognized.
+int namedKey(std::string name) {
+  for (auto &c : name) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  if (name == "esc") return '\33';
+  if (name == "cr" || name == "enter") return '\r';
+  if (name == "bs") return '\x7f';
+  if (name == "tab") return '\t';
+  if (name == "space") return ' ';
+  if (name == "lt") return '<';
+  if (size(name) == 3 && name[0] == 'c' && name[1] == '-' &&
+    name[2] >= 'a' && name[2] <= 'z') {
+    return name[2] - 'a' + 1;
+  }
+  return -1;
+}
+
+}  // namespace
+
+std::string parseKeyScript(const std::string &script) {
+  std::string keys;
+  keys.reserve(size(script));
+  for (std::size_t i = 0; i < size(script); ++i) {
+    char c = script[i];
+    if (c == '\n') {
+      keys += '\r';
+      continue;
+    }
+    if (c == '<') {
+      auto close = script.find('>', i);
+      if (close != std::string::npos) {
+        int key = namedKey(script.substr(i + 1, close - i - 1));
+        if (key != -1) {
+          keys += static_cast<char>(key);
+          i = close;
+          continue;
+        }
+      }
+    }
+    keys += c;
+  }
+  return keys;
+}
+
+std::optional<std::string> loadKeyScript(const std::filesystem::path &path) {
+  // A directory can be opened, but not read.
+  std::error_code error;
+  if (std::filesystem::is_directory(path, error)) return std::nullopt;
+  std::ifstream fin(path, std::ios::binary);
+  if (!fin) return std::nullopt;
+  std::stringstream contents;
+  contents << fin.rdbuf();
+  if (fin.bad()) return std::nullopt;
+  return parseKeyScript(contents.str());
+}
+
+}  // namespace dvim
@@ -0,0 +1,34 @@
+// Copyright 2022 Daniel Liu
+
+// Keystroke scripts.
+
+#ifndef DVIM_KEY_SCRIPT_HPP_
+#define DVIM_KEY_SCRIPT_HPP_
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace dvim {
+
+/*
+ * Parses a keystroke script into the raw keys that a terminal would send.
+ * Characters are taken literally, except that a newline is sent as ENTER, and
+ * the following vim-style key names are recognized:
+ * <Esc>, <CR>, <BS>, <Tab>, <Space>, <lt>, and <C-x> for a control key.
+ * Anything else between angle brackets is taken literally.
+ * @param script The script to parse.
+ * @return The keys in the script.
+ */
+std::string parseKeyScript(const std::string &script);
+
+/*
+ * Reads and parses the keystroke script at the specified path.
+ * @param path The path to the script.
+ * @return The keys in the script, or std::nullopt if the file cannot be read.
+ */
+std::optional<std::string> loadKeyScript(const std::filesystem::path &path);
+
+}  // namespace dvim
+
+#endif
@@ -5,66 +5,93 @@
 #include "PreviewWindow.hpp"
 
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
-#include "dcurses/Base64.hpp"
+#include "dcurses/ImageCache.hpp"
+#include "dcurses/TextCells.hpp"
 #include "dcurses/Window.hpp"
 #include "dcurses/WindowManager.hpp"
 #include "dvim/TextFileLayout.hpp"
 
 namespace dvim {
 
-PreviewWindow::PreviewWindow(const std::filesystem::path &path, dcurses::WindowManager &manager)
-    : windowManager_(manager), path_(path) {
-  manager.addWindow("preview", {0, 30, manager.getWidth() - 30, manager.getHeight() - 10, 0, DOUBLE_BORDER});
-  window_ = manager["preview"];
+PreviewWindow::PreviewWindow(const std::filesystem::path &path, dcurses::WindowManager &manager,
+  dcurses::ImageCache &imageCache) : windowManager_(manager), imageCache_(imageCache), path_(path) {
+  using dcurses::Extent;
+  window_ = manager.addWindow({0, 30, Extent::fromEnd(-30), Extent::fromEnd(-10), 0, DOUBLE_BORDER});
 }
 
 PreviewWindow::~PreviewWindow() {
-  windowManager_.removeWindow("preview");
+  windowManager_.removeWindow(window_);
 }
 
 void PreviewWindow::refresh() {
-  window_->clear();
+  auto &window = windowManager_[window_];
+  window.clear();
   if (std::filesystem::is_regular_file(path_) == false) {
     return;
   }
+
+  std::string title = " " + path_.filename().string() + " (preview) ";
+  window.setString(0, 2, title);
+
+  // The preview is inset by two columns on each side and one row at the top and bottom. The
+  // window can be smaller than that after the terminal is resized.
+  unsigned int columns = window.width() > 4 ? window.width() - 4 : 0;
+  unsigned int rows = window.height() > 2 ? window.height() - 2 : 0;
+  if (columns == 0 || rows == 0) {
+    return;
+  }
+
+  // Images are read through the cache, so an unchanged image is not read again. They are scaled
+  // down to the size of the preview in pixels, and then shown over as many cells as they cover.
+  if (path_.extension() == ".png" || path_.extension() == ".jpg" || path_.extension() == ".jpeg") {
+    unsigned int cellWidth = windowManager_.terminal().cellPixelWidth();
+    unsigned int cellHeight = windowManager_.terminal().cellPixelHeight();
+    auto image = imageCache_.load(path_, columns * cellWidth, rows * cellHeight);
+    if (image) {
+      if (image->width != 0 && image->height != 0) {
+        columns = std::clamp((image->width + cellWidth - 1) / cellWidth, 1u, columns);
+        rows = std::clamp((image->height + cellHeight - 1) / cellHeight, 1u, rows);
+      }
+      window.drawImage({1, 2, columns, rows, image});
+    } else {
+      window.setString(2, 2, "Unreadable image");
+    }
+    return;
+  }
+
   std::ifstream fs(path_, std::ios::binary);
   std::stringstream contentstream;
   contentstream << fs.rdbuf();
   std::string contents = contentstream.str();
 
-  // rough heuristic for ASCII vs binary
-  bool isImage = false;
-  if (path_.extension() == ".png" || path_.extension() == ".jpg" || path_.extension() == ".jpeg") {
-    isImage = true;
+  // Rough heuristic for text vs binary: text is valid UTF-8 without NUL bytes.
+  bool isBinary = false;
+  for (std::size_t i = 0; i < size(contents) && !isBinary; ) {
+    std::size_t length;
+    uint32_t codePoint = dcurses::decodeUtf8(std::string_view{contents}.substr(i), length);
+    isBinary = codePoint == 0 || (codePoint == 0xfffd && length == 1);
+    i += length;
   }
 
-  bool isBinary = !std::all_of(contents.begin(), contents.end(), [](char c) { return c >= 0; });
-
-  std::string title = " " + path_.filename().string() + " (preview) ";
-  window_->setString(0, 2, title);
-
-  if (isImage) {
-    std::ifstream img(path_, std::ios::binary);
-    std::stringstream contentstream;
-    contentstream << img.rdbuf();
-    std::string content = contentstream.str();
-    window_->drawImage({1, 2, window_->width() - 4, window_->height() - 2, content});
-  } else if (isBinary) {
-    window_->setString(2, 2, "Binary file");
+  if (isBinary) {
+    window.setString(2, 2, "Binary file");
   } else {
     // Regular text
-    auto layout = layoutFileWithLineNums(contents, window_->width() - 4);
-    for (unsigned int row = 1; row < window_->height() - 1; ++row) {
+    auto layout = layoutFileWithLineNums(contents, columns);
+    for (unsigned int row = 1; row <= rows; ++row) {
       if (row > size(layout)) break;
       unsigned int col = 2;
-      window_->setString(row, col, layout[row - 1]);
+      window.setString(row, col, layout[row - 1]);
     }
   }
 }
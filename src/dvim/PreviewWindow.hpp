@@ -8,6 +8,7 @@
 #include <filesystem>
 #include <memory>
 
+#include "dcurses/ImageCache.hpp"
 #include "dcurses/Window.hpp"
 #include "dcurses/WindowManager.hpp"
 #include "dvim/TextFileLayout.hpp"
@@ -19,7 +20,12 @@ namespace dvim {
  */
 class PreviewWindow {
  public:
-  PreviewWindow(const std::filesystem::path &path, dcurses::WindowManager &manager);
+  /*
+   * Constructs the preview window in the specified window manager. Images are loaded through
+   * `imageCache`, which outlives the preview window.
+   */
+  PreviewWindow(const std::filesystem::path &path, dcurses::WindowManager &manager,
+                dcurses::ImageCache &imageCache);
 
   /*
    * Destroys the preview window, and removes the corresponding window.
@@ -38,7 +44,8 @@ class PreviewWindow {
 
  private:
   dcurses::WindowManager &windowManager_;
-  std::shared_ptr<dcurses::Window> window_;
+  dcurses::ImageCache &imageCache_;
+  dcurses::WindowHandle window_;
   std::filesystem::path path_;
 };
 
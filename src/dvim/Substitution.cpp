@@ -0,0 +1,123 @@
+// Copyright 2022 Daniel Liu
+
+// Matcher and replacer for the :substitute command.
+
+#include "Substitution.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace dvim {
+
+Substitution::Substitution(const std::string &pattern, const std::string &replacement,
+                           bool global, bool ignoreCase) :
+  pattern_ {pattern}, global_ {global} {
+  if (!ignoreCase && pattern_.find_first_of(".^$|()[]{}*+?\\") == std::string::npos) {
+    searcher_.emplace(pattern_.cbegin(), pattern_.cend());
+  } else {
+    auto flags = std::regex::ECMAScript | std::regex::optimize;
+    if (ignoreCase) {
+      flags |= std::regex::icase;
+    }
+    regex_ = std::regex(pattern_, flags);
+  }
+
+  // Split the replacement into literal text and group references.
+  std::string literal;
+  auto addGroup = [&](int group) {
+    if (!literal.empty()) {
+      replacement_.push_back({literal, -1});
+      literal.clear();
+    }
+    replacement_.push_back({"", group});
+  };
+  for (std::size_t i = 0; i < size(replacement); ++i) {
+    char c = replacement[i];
+    if (c == '&') {
+      addGroup(0);
+    } else if (c == '\\' && i + 1 < size(replacement)) {
+      char next = replacement[++i];
+      if (next >= '0' && next <= '9') {
+        addGroup(next - '0');
+      } else if (next == 'r') {
+        literal += '\n';
+      } else if (next == 'n') {
+        // As in vim, \n inserts a NUL; only \r breaks the line.
+        literal += '\0';
+      } else if (next == 't') {
+        literal += '\t';
+      } else {
+        literal += next;
+      }
+    } else {
+      literal += c;
+    }
+  }
+  if (!literal.empty()) {
+    replacement_.push_back({literal, -1});
+  }
+}
+
+unsigned int Substitution::apply(const std::string &line, std::string &result) const {
+  unsigned int count = 0;
+  std::size_t pos = 0;
+  std::smatch match;
+
+  while (pos <= size(line)) {
+    std::size_t matchBegin;
+    std::size_t matchLength;
+    if (searcher_) {
+      auto it = std::search(line.cbegin() + static_cast<std::ptrdiff_t>(pos), line.cend(), *searcher_);
+      if (it == line.cend() && !pattern_.empty()) {
+        break;
+      }
+      matchBegin = static_cast<std::size_t>(it - line.cbegin());
+      matchLength = size(pattern_);
+    } else {
+      auto flags = pos == 0 ? std::regex_constants::match_default :
+        std::regex_constants::match_prev_avail;
+      if (!std::regex_search(line.cbegin() + static_cast<std::ptrdiff_t>(pos), line.cend(),
+        match, regex_, flags)) {
+        break;
+      }
+      matchBegin = pos + static_cast<std::size_t>(match.position(0));
+      matchLength = static_cast<std::size_t>(match.length(0));
+    }
+
+    if (count == 0) {
+      result.clear();
+    }
+    result.append(line, pos, matchBegin - pos);
+    for (const auto &piece : replacement_) {
+      if (piece.group == -1) {
+        result += piece.literal;
+      } else if (piece.group == 0) {
+        result.append(line, matchBegin, matchLength);
+      } else if (!searcher_ && static_cast<std::size_t>(piece.group) < size(match)) {
+        result += match[static_cast<std::size_t>(piece.group)].str();
+      }
+    }
+    ++count;
+    pos = matchBegin + matchLength;
+    if (matchLength == 0) {
+      // Step over a character after an empty match so that the search
+      // makes progress.
+      if (pos < size(line)) {
+        result += line[pos];
+      }
+      ++pos;
+    }
+    if (!global_) {
+      break;
+    }
+  }
+  if (count != 0 && pos < size(line)) {
+    result.append(line, pos, std::string::npos);
+  }
+  return count;
+}
+
+}  // namespace dvim
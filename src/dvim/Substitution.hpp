@@ -0,0 +1,65 @@
+// Copyright 2022 Daniel Liu
+
+// Matcher and replacer for the :substitute command.
+
+#ifndef DVIM_SUBSTITUTION_HPP_
+#define DVIM_SUBSTITUTION_HPP_
+
+#include <functional>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace dvim {
+
+/*
+ * A compiled substitution. Patterns without regex metacharacters are matched
+ * with a Boyer-Moore-Horspool searcher; all other patterns are compiled into a
+ * std::regex once.
+ *
+ * The replacement uses vim syntax: & and \0 insert the whole match, \1 to \9
+ * insert a group, \r inserts a line break, \n inserts a NUL (as in vim), \t
+ * inserts a tab, and \& and \\ insert a literal & or \.
+ */
+class Substitution {
+ public:
+  /*
+   * Compiles the pattern and replacement.
+   * @throws std::regex_error if the pattern is not a valid regex.
+   */
+  Substitution(const std::string &pattern, const std::string &replacement,
+               bool global, bool ignoreCase);
+
+  /*
+   * The searcher refers to pattern_, so substitutions cannot be copied or
+   * moved.
+   */
+  Substitution(const Substitution &other) = delete;
+  Substitution &operator=(const Substitution &other) = delete;
+
+  /*
+   * Applies the substitution to a single line.
+   * @param line The line to search.
+   * @param result Receives the substituted line, if anything was replaced.
+   * Line breaks inserted by the replacement are written as '\n'.
+   * @return The number of replacements made.
+   */
+  unsigned int apply(const std::string &line, std::string &result) const;
+
+ private:
+  struct ReplacementPiece {
+    std::string literal;
+    int group;  // -1 for a literal piece
+  };
+
+  std::string pattern_;
+  std::vector<ReplacementPiece> replacement_;
+  bool global_;
+  std::optional<std::boyer_moore_horspool_searcher<std::string::const_iterator>> searcher_;
+  std::regex regex_;
+};
+
+}  // namespace dvim
+
+#endif
@@ -8,7 +8,7 @@
 #include <string>
 #include <vector>
 
-#include "Utilities.hpp"
+#include "dcurses/TextCells.hpp"
 
 namespace dvim {
 
@@ -50,8 +50,15 @@ std::vector<std::string> layoutFileWithLineNums(const std::string& fileContents,
   line += "\33[38;5;243m" + std::to_string(lineNumber++) + "\33[0m";
   line += " ";
 
-  for (char ch : fileContents) {
-    if (ch == '\n') {
+  // Lines are wrapped by display width, which starts with the line number and a space. Escape
+  // sequences in the file are copied along with the cells around them.
+  unsigned int lineWidth = leftPadding + 1;
+  std::size_t copied = 0;
+  for (const dcurses::TextCell &cell : dcurses::TextCells{fileContents}) {
+    std::size_t start = static_cast<std::size_t>(cell.text.data() - fileContents.data());
+    if (cell.text[0] == '\n') {
+      line.append(fileContents, copied, start - copied);
+      copied = start + size(cell.text);
       lines.emplace_back(line);
       line.clear();
       for (unsigned int i = 0; i < leftPadding - size(std::to_string(lineNumber)); ++i) {
@@ -59,17 +66,22 @@ std::vector<std::string> layoutFileWithLineNums(const std::string& fileContents,
       }
       line += "\33[38;5;243m" + std::to_string(lineNumber++) + "\33[0m";
       line += " ";
+      lineWidth = leftPadding + 1;
     } else {
-      line.push_back(ch);
-      if (size(dvim::splitVisibleCharacters(line)) >= width) {
+      line.append(fileContents, copied, start + size(cell.text) - copied);
+      copied = start + size(cell.text);
+      lineWidth += cell.width;
+      if (lineWidth >= width) {
         lines.emplace_back(line);
         line.clear();
         for (unsigned int i = 0; i < leftPadding + 1; ++i) {
           line.push_back(' ');
         }
+        lineWidth = leftPadding + 1;
       }
     }
   }
+  line.append(fileContents, copied, std::string::npos);
 
   if (size(line) > leftPadding + 16 || size(lines) == 0) {
     lines.emplace_back(line);
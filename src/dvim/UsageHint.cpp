@@ -22,7 +22,11 @@ std::vector<std::string> layoutUsageHints(const std::vector<std::string> &hints,
   if (columns > size(hints)) {
     columns = size(hints);
   }
-  unsigned long spacingLeft = width - columns * longestHint;
+  // On a narrow screen, hints are one per line and the window clips them.
+  if (columns == 0) {
+    columns = 1;
+  }
+  unsigned long spacingLeft = width > columns * longestHint ? width - columns * longestHint : 0;
   std::vector<std::string> result;
   for (unsigned long i = 0; i < size(hints); i += columns) {
     std::string line = "";
@@ -15,20 +15,22 @@
 namespace dvim {
 
 UsageHintView::UsageHintView(dcurses::WindowManager &manager) : windowManager_(manager), hints_ {} {
-  manager.addWindow("usageHints", {manager.getHeight() - 10, 0, manager.getWidth(), 9, 0, DEFAULT_BORDER});
-  window_ = manager["usageHints"];
+  using dcurses::Extent;
+  window_ = manager.addWindow({Extent::fromEnd(-10), 0, Extent::fromEnd(0), 9, 0, DEFAULT_BORDER});
 }
 
 UsageHintView::~UsageHintView() {
-  windowManager_.removeWindow("usageHints");
+  windowManager_.removeWindow(window_);
 }
 
 void UsageHintView::refresh() {
-  window_->clear();
+  auto &window = windowManager_[window_];
+  window.clear();
   unsigned int row = 1;
-  for (auto line : layoutUsageHints(hints_, window_->width() - 4)) {
+  unsigned int width = window.width() > 4 ? window.width() - 4 : 0;
+  for (auto line : layoutUsageHints(hints_, width)) {
     unsigned int col = 2;
-    window_->setString(row, col, line);
+    window.setString(row, col, line);
     row++;
   }
 }
@@ -42,7 +42,7 @@ class UsageHintView {
 
  private:
   dcurses::WindowManager &windowManager_;
-  std::shared_ptr<dcurses::Window> window_;
+  dcurses::WindowHandle window_;
   std::vector<std::string> hints_;
 };
 
@@ -6,7 +6,6 @@
 #define UTILITIES_HPP_
 
 #include <string>
-#include <vector>
 
 namespace dvim {
 
@@ -16,14 +15,6 @@ namespace dvim {
  */
 std::string escapeString(const std::string &str);
 
-/*
- * Splits the string into a vector, where each element can be printed out as a one-wide character.
- * Handles splitting color/graphics ANSI escape sequences.
- * @param str The string to split.
- * @return A vector of strings, where each string is a one-wide character
- */
-std::vector<std::string> splitVisibleCharacters(const std::string &str);
-  
 }  // namespace dvim
 
 #endif
@@ -8,6 +8,9 @@
 #include <memory>
 #include <stdio.h>
 
+#include <poll.h>
+
+#include "dcurses/Terminal.hpp"
 #include "dcurses/Window.hpp"
 #include "dcurses/WindowManager.hpp"
 #include "FileTreeView.hpp"
@@ -17,9 +20,9 @@
 
 namespace dvim {
 
-dvimController::dvimController() : 
-  manager_{}, ftv_{".", manager_}, uhv_{manager_}, 
-  pw_{std::make_unique<dvim::PreviewWindow>(std::filesystem::path{"text.txt"}, manager_)} {
+dvimController::dvimController(dcurses::Terminal &terminal) : 
+  manager_{terminal}, watcher_{}, imageCache_{}, ftv_{".", manager_, watcher_}, uhv_{manager_},
+  pw_{std::make_unique<dvim::PreviewWindow>(std::filesystem::path{"text.txt"}, manager_, imageCache_)} {
   uhv_.setHints(std::vector<std::string>{
     " j - down",
     " k - up",
@@ -30,48 +33,98 @@ dvimController::dvimController() :
 }
 
 void dvimController::switchToEditor() {
+  switchToEditor(ftv_.getSelectedPath());
+}
+
+void dvimController::switchToEditor(const std::filesystem::path &path) {
   pw_.reset();
-  ev_ = std::make_unique<dvim::EditorView>(ftv_.getSelectedPath(), manager_, *this);
+  ev_ = std::make_unique<dvim::EditorView>(path, manager_, *this, watcher_);
   state = dvimState::EDITOR;
 }
 
 void dvimController::switchToPreview() {
   ev_.reset();
-  pw_ = std::make_unique<dvim::PreviewWindow>(ftv_.getSelectedPath(), manager_);
+  pw_ = std::make_unique<dvim::PreviewWindow>(ftv_.getSelectedPath(), manager_, imageCache_);
   state = dvimState::PREVIEW;
 }
 
 void dvimController::run() {
+  // Write frames on their own thread, so that a slow terminal does not hold up handling keys.
+  manager_.startRenderThread();
   while (true) {
-    if (state == dvimState::PREVIEW) {
-      pw_->setPath(ftv_.getSelectedPath());
-      pw_->refresh();
-    } else if (state == dvimState::EDITOR) {
-      ev_->refresh();
-      uhv_.setHints(ev_->getUsageHints());
+    refresh();
+    if (!waitForKey()) {
+      continue;
+    }
+    int ch = manager_.terminal().readKey();
+    if (ch == -1) {
+      break;
+    }
+    LOG("Got input: " + std::to_string(ch));
+    if (!handleInput(static_cast<char>(ch))) {
+      break;
     }
-    LOG("Refreshing file tree and usage hints...");
-    ftv_.refresh();
-    uhv_.refresh();
-    LOG("Refreshing manager window...");
-    manager_.refresh();
-    LOG("Finished refreshing.");
-    char ch = (char) getc(stdin);
-    LOG("Got input: " + std::to_string(static_cast<int>(ch)));
-    if (state == dvimState::PREVIEW) {
-      if (ch == 'q') {
-        break;
-      } else if (ch == '\r') {
-        // move to editor
-        switchToEditor();
-        manager_.refresh();
-      } else {
-        ftv_.handleInput(ch);
-      }
-    } else if (state == dvimState::EDITOR) {
-      ev_->handleInput(ch);
+  }
+}
+
+bool dvimController::waitForKey() {
+  // Waits for a key, for files to change on disk, or for the terminal to be
+  // resized. Returns true if a key is ready to be read.
+  int terminalFd = manager_.terminal().fd();
+  if (terminalFd == -1) {
+    return true;
+  }
+  // Unavailable descriptors are ignored by poll.
+  struct pollfd fds[3] = {
+    {terminalFd, POLLIN, 0}, {watcher_.fd(), POLLIN, 0}, {manager_.terminal().resizeFd(), POLLIN, 0}};
+  if (poll(fds, 3, -1) == -1) {
+    return false;
+  }
+  if (fds[1].revents & POLLIN) {
+    auto changes = watcher_.readChanges();
+    LOG("Files changed on disk: " + std::to_string(size(changes)));
+    ftv_.handleFileChanges(changes);
+    if (ev_) {
+      ev_->handleFileChanges(changes);
+    }
+  }
+  // A resize is picked up by the next refresh.
+  return fds[0].revents & (POLLIN | POLLHUP | POLLERR);
+}
+
+void dvimController::refresh() {
+  manager_.beginFrame();
+  // Lay the windows out again before the views draw into them.
+  manager_.updateSize();
+  if (state == dvimState::PREVIEW) {
+    pw_->setPath(ftv_.getSelectedPath());
+    pw_->refresh();
+  } else if (state == dvimState::EDITOR) {
+    ev_->refresh();
+    uhv_.setHints(ev_->getUsageHints());
+  }
+  LOG("Refreshing file tree and usage hints...");
+  ftv_.refresh();
+  uhv_.refresh();
+  LOG("Refreshing manager window...");
+  manager_.refresh();
+  LOG("Finished refreshing.");
+}
+
+bool dvimController::handleInput(char ch) {
+  if (state == dvimState::PREVIEW) {
+    if (ch == 'q') {
+      return false;
+    } else if (ch == '\r') {
+      // move to editor
+      switchToEditor();
+    } else {
+      ftv_.handleInput(ch);
     }
+  } else if (state == dvimState::EDITOR) {
+    ev_->handleInput(ch);
   }
+  return true;
 }
 
 }
@@ -5,13 +5,17 @@
 #ifndef DVIM_DVIM_HPP_
 #define DVIM_DVIM_HPP_
 
+#include <filesystem>
 #include <memory>
 
 #include "FileTreeView.hpp"
+#include "FileWatcher.hpp"
 #include "UsageHintView.hpp"
 #include "PreviewWindow.hpp"
 #include "EditorView.hpp"
 
+#include "dcurses/ImageCache.hpp"
+#include "dcurses/Terminal.hpp"
 #include "dcurses/WindowManager.hpp"
 
 namespace dvim {
@@ -22,25 +26,46 @@ namespace dvim {
 class dvimController {
  public:
   /*
-   * Initialize the controller.
+   * Initialize the controller, rendering to the specified terminal.
    */
-  dvimController();
+  explicit dvimController(dcurses::Terminal &terminal);
 
   /*
-   * Run dvim.
+   * Run dvim, reading keys from the terminal until the user quits.
    */
   void run();
 
+  /*
+   * Refresh all views and render them to the terminal.
+   */
+  void refresh();
+
+  /*
+   * Handle a single key of input.
+   * @return false if dvim should exit, true otherwise.
+   */
+  bool handleInput(char ch);
+
   /*
    * Switch to the EDITOR state.
    */
   void switchToEditor();
 
+  /*
+   * Switch to the EDITOR state, editing the specified file.
+   */
+  void switchToEditor(const std::filesystem::path &path);
+
   /*
    * Switch back to PREVIEW state.
    */
   void switchToPreview();
 
+  /*
+   * The render counters of the frames drawn so far.
+   */
+  const dcurses::FrameStats &frameStats() const { return manager_.stats(); }
+
  private:
   enum dvimState {
     PREVIEW,
@@ -48,7 +73,11 @@ class dvimController {
   };
   dvimState state = dvimState::PREVIEW;
 
+  bool waitForKey();
+
   dcurses::WindowManager manager_;
+  dvim::FileWatcher watcher_;
+  dcurses::ImageCache imageCache_;
   dvim::FileTreeView ftv_;
   dvim::UsageHintView uhv_;
   std::unique_ptr<dvim::PreviewWindow> pw_;
@@ -2,67 +2,90 @@
 
 #include "dvim/dvim.hpp"
 #include "dcurses/Base64.hpp"
+#include "dcurses/Terminal.hpp"
 
+#include "dvim/Batch.hpp"
 #include "dvim/Editor.hpp"
+#include "dvim/KeyScript.hpp"
 
+#include <charconv>
 #include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <optional>
 #include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "Logging.hpp"
 
-class RawSTTY {
- public:
-  RawSTTY() {
-    // Save the screen.
-    if (system("tput smcup")) {
-      std::cout << "tput smcup failed" << std::endl;
-      exit(1);
+// Largest number of batch jobs accepted by -j.
+#define MAX_BATCH_JOBS 1024
+
+int main(int argc, char **argv) {
+  // Batch mode: dvim -s script.keys [-j jobs] file...
+  if (argc > 1 && std::string{argv[1]} == "-s") {
+    if (argc < 4) {
+      std::cerr << "usage: dvim -s script.keys [-j jobs] file..." << std::endl;
+      return 1;
     }
-    std::cout << "\33[?47h" << std::flush;
-    FILE* saved_stty = popen("stty -g", "r");
-    char buf[1024];
-    saved_ = std::string(fgets(buf, 1024, saved_stty));
-    if (system("stty raw")) {
-      std::cout << "stty raw failed" << std::endl;
-      exit(1);
+    auto keys = dvim::loadKeyScript(argv[2]);
+    if (!keys) {
+      std::cerr << "dvim: cannot read keystroke script " << argv[2] << std::endl;
+      return 1;
     }
-  }
-  ~RawSTTY() {
-    if (system((std::string("stty ") + saved_).c_str())) {
-      std::cout << "stty restore failed" << std::endl;
-      exit(1);
+    unsigned int jobs = 0;
+    std::vector<std::filesystem::path> paths;
+    for (int i = 3; i < argc; ++i) {
+      if (std::string{argv[i]} == "-j" && i + 1 < argc) {
+        std::string_view value {argv[++i]};
+        auto [end, error] = std::from_chars(value.data(), value.data() + size(value), jobs);
+        if (error != std::errc{} || end != value.data() + size(value) || jobs == 0 || jobs > MAX_BATCH_JOBS) {
+          std::cerr << "dvim: -j expects a number of jobs from 1 to " << MAX_BATCH_JOBS << std::endl;
+          std::cerr << "usage: dvim -s script.keys [-j jobs] file..." << std::endl;
+          return 1;
+        }
+      } else {
+        paths.emplace_back(argv[i]);
+      }
     }
-    // Restore the screen
-    if (system("tput rmcup")) {
-      std::cout << "tput rmcup failed" << std::endl;
-      exit(1);
+    return dvim::runBatch(*keys, paths, jobs) == 0 ? 0 : 1;
+  }
+
+  // Render counters: dvim --perf-dump stats.csv|stats.json
+  std::optional<std::filesystem::path> perfDump;
+  if (argc > 1 && std::string{argv[1]} == "--perf-dump") {
+    if (argc < 3) {
+      std::cerr << "usage: dvim --perf-dump file.csv|file.json" << std::endl;
+      return 1;
     }
+    perfDump = argv[2];
   }
- private:
-  std::string saved_;
-};
 
-int main() {
-  RawSTTY stty;
+  dcurses::TtyTerminal terminal;
+
+  // kitty graphics protocol detection, which is preferred over iterm2 inline images
+  dcurses::Window::setKitty(terminal.kittyGraphics());
 
   // iterm2 detection
-  FILE* fp = popen("echo $LC_TERMINAL", "r");
-  char value[2];
-  dcurses::Window::setIterm2(fread(&value, 1, 2, fp) == 2);
+  dcurses::Window::setIterm2(terminal.iterm2Images());
 
   // tmux detection
-  std::string term {std::getenv("TERM")};
-  if (std::regex_match(term, std::regex{"(screen|tmux).*"})) {
+  std::string_view term = std::getenv("TERM") != nullptr ? std::getenv("TERM") : "";
+  if (std::getenv("TMUX") != nullptr || term.rfind("screen", 0) == 0 || term.rfind("tmux", 0) == 0) {
     LOG("tmux detected");
     dcurses::Window::setTmux(1);
   }
 
-  dvim::dvimController controller;
+  dvim::dvimController controller {terminal};
   controller.run();
+
+  if (perfDump && !controller.frameStats().save(*perfDump)) {
+    std::cerr << "dvim: could not write " << perfDump->string() << std::endl;
+    return 1;
+  }
 }
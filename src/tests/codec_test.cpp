@@ -0,0 +1,254 @@
+// Copyright 2022 Daniel Liu
+
+// Tests for the image codecs, which parse untrusted files on the render path. Decodes valid
+// images written by libpng and libjpeg, then feeds the decoders truncated, corrupted and
+// malicious input. Built with AddressSanitizer (make test), so any out-of-bounds access fails
+// the test even if the decoder happens to return.
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "dcurses/Bitmap.hpp"
+#include "dcurses/Jpeg.hpp"
+#include "dcurses/Png.hpp"
+#include "dcurses/Zlib.hpp"
+
+namespace {
+
+unsigned int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::cerr << "FAIL: " << what << "\n";
+    ++failures;
+  }
+}
+
+std::string readFile(const std::filesystem::path &path) {
+  std::ifstream file {path, std::ios::binary};
+  if (!file) {
+    std::cerr << "cannot read " << path << "\n";
+    std::exit(1);
+  }
+  return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+uint64_t hashPixels(const dcurses::Bitmap &bitmap) {
+  uint64_t hash = 14695981039346656037ull;
+  for (uint8_t byte : bitmap.pixels) {
+    hash = (hash ^ byte) * 1099511628211ull;
+  }
+  return hash;
+}
+
+void putBigEndian(std::string &data, std::size_t offset, uint32_t value, unsigned int bytes) {
+  for (unsigned int i = 0; i < bytes; ++i) {
+    data[offset + i] = static_cast<char>(value >> (8 * (bytes - 1 - i)));
+  }
+}
+
+/*
+ * Returns the offset of the first JPEG segment with the specified marker, or std::string::npos.
+ */
+std::size_t findSegment(const std::string &jpeg, unsigned char marker) {
+  std::size_t position = 2;
+  while (position + 4 <= size(jpeg) && static_cast<unsigned char>(jpeg[position]) == 0xff) {
+    if (static_cast<unsigned char>(jpeg[position + 1]) == marker) return position;
+    position += 2 + (static_cast<unsigned char>(jpeg[position + 2]) << 8 | static_cast<unsigned char>(jpeg[position + 3]));
+  }
+  return std::string::npos;
+}
+
+/*
+ * Builds a PNG from an IHDR and the compressed image data. The decoder does not check CRCs, so
+ * they are left as zero.
+ */
+std::string makePng(uint32_t width, uint32_t height, unsigned char colorType, std::string_view compressed) {
+  auto chunk = [](std::string_view type, std::string_view contents) {
+    std::string out(4, '\0');
+    putBigEndian(out, 0, static_cast<uint32_t>(size(contents)), 4);
+    out.append(type);
+    out.append(contents);
+    out.append(4, '\0');
+    return out;
+  };
+  std::string header(13, '\0');
+  putBigEndian(header, 0, width, 4);
+  putBigEndian(header, 4, height, 4);
+  header[8] = 8;
+  header[9] = static_cast<char>(colorType);
+  return "\x89PNG\r\n\x1a\n" + chunk("IHDR", header) + chunk("IDAT", compressed) + chunk("IEND", "");
+}
+
+// Hashes of the RGBA pixels libpng decodes each image to, with 16-bit samples stripped to 8.
+const struct {
+  const char *name;
+  uint64_t hash;
+} PNG_IMAGES[] = {
+  {"gray1.png", 0x65abe150b2253bb8ull},
+  {"gray4.png", 0x19381b432104d6c8ull},
+  {"gray16.png", 0xddfef33096a6ab87ull},
+  {"rgb8.png", 0xbdb6052c31e5635dull},
+  {"rgb16.png", 0xa0a2602a6a4b76b0ull},
+  {"palette2.png", 0xe9f1158f9ead434dull},
+  {"palette8_interlaced.png", 0x792bd258fe990414ull},
+  {"graya8.png", 0x3a4f689388d7ad1aull},
+  {"rgba8_interlaced.png", 0xddb3edc7c0232441ull},
+  {"rgba16.png", 0x783fbead6d09a156ull},
+};
+
+// JPEGs of a gradient: red rises from left to right, green from top to bottom, and blue is 128.
+// Grayscale images hold the mean of red and green.
+const char *JPEG_IMAGES[] = {"gray.jpg", "ycc444.jpg", "ycc422.jpg", "ycc420.jpg", "ycc420_restart.jpg"};
+
+/*
+ * Returns the mean absolute difference between a decoded JPEG and the gradient it was made from.
+ */
+double gradientError(const dcurses::Bitmap &bitmap, bool gray) {
+  double error = 0;
+  for (unsigned int y = 0; y < bitmap.height; ++y) {
+    for (unsigned int x = 0; x < bitmap.width; ++x) {
+      double red = bitmap.width > 1 ? x * 255.0 / (bitmap.width - 1) : 0;
+      double green = bitmap.height > 1 ? y * 255.0 / (bitmap.height - 1) : 0;
+      double expected[3] = {red, green, 128};
+      if (gray) expected[0] = expected[1] = expected[2] = (red + green) / 2;
+      const uint8_t *pixel = &bitmap.pixels[(static_cast<std::size_t>(y) * bitmap.width + x) * 4];
+      for (unsigned int c = 0; c < 3; ++c) {
+        error += std::abs(pixel[c] - expected[c]);
+      }
+    }
+  }
+  return error / (3.0 * bitmap.width * bitmap.height);
+}
+
+/*
+ * Decodes every prefix of a file, and a series of copies with random bytes changed. Only memory
+ * errors fail, which AddressSanitizer reports.
+ */
+template <typename F>
+void decodeDamaged(const std::string &data, F decode) {
+  for (std::size_t length = 0; length < size(data); ++length) {
+    decode(std::string_view{data}.substr(0, length));
+  }
+  std::mt19937 random {1};
+  for (unsigned int i = 0; i < 500; ++i) {
+    std::string damaged = data;
+    for (unsigned int j = 0; j <= i % 4; ++j) {
+      damaged[random() % size(damaged)] = static_cast<char>(random());
+    }
+    decode(damaged);
+  }
+}
+
+void testPng(const std::filesystem::path &images) {
+  for (const auto &image : PNG_IMAGES) {
+    std::string data = readFile(images / image.name);
+    auto bitmap = dcurses::decodePng(data);
+    check(bitmap && bitmap->width == 13 && bitmap->height == 9 && hashPixels(*bitmap) == image.hash,
+          std::string{"decode "} + image.name);
+    if (bitmap) {
+      auto encoded = dcurses::decodePng(dcurses::encodePng(*bitmap));
+      check(encoded && encoded->pixels == bitmap->pixels, std::string{"encode "} + image.name);
+    }
+    decodeDamaged(data, [](std::string_view damaged) { dcurses::decodePng(damaged); });
+  }
+
+  std::string pixel = dcurses::zlibCompress(std::string("\0\1\2\3", 4));
+  check(dcurses::decodePng(makePng(1, 1, 2, pixel)).has_value(), "decode minimal PNG");
+  check(!dcurses::decodePng(makePng(0x10000, 0x10000, 2, pixel)), "reject oversized PNG");
+  check(!dcurses::decodePng(makePng(1, 1, 2, "")), "reject PNG without image data");
+
+  // A 1x1 image whose data inflates to 16 MB.
+  std::string bomb = dcurses::zlibCompress(std::string(16 << 20, '\0'));
+  check(!dcurses::decodePng(makePng(1, 1, 2, bomb)), "reject PNG deflate bomb");
+}
+
+void testJpeg(const std::filesystem::path &images) {
+  for (const char *name : JPEG_IMAGES) {
+    std::string data = readFile(images / name);
+    bool gray = std::string_view{name} == "gray.jpg";
+    auto bitmap = dcurses::decodeJpeg(data);
+    check(bitmap && gradientError(*bitmap, gray) < 4, std::string{"decode "} + name);
+
+    // Scaled decoding stops at the smallest scale that still covers the fitted size.
+    if (bitmap) {
+      unsigned int maxWidth = bitmap->width / 3;
+      unsigned int maxHeight = bitmap->height / 3;
+      auto scaled = dcurses::decodeJpeg(data, maxWidth, maxHeight);
+      unsigned int fittedWidth;
+      unsigned int fittedHeight;
+      dcurses::fittedSize(bitmap->width, bitmap->height, maxWidth, maxHeight, fittedWidth, fittedHeight);
+      check(scaled && scaled->width >= fittedWidth && scaled->height >= fittedHeight &&
+            scaled->width < bitmap->width && gradientError(*scaled, gray) < 8,
+            std::string{"scaled decode "} + name);
+    }
+    decodeDamaged(data, [](std::string_view damaged) {
+      dcurses::decodeJpeg(damaged);
+      dcurses::decodeJpeg(damaged, 4, 4);
+    });
+  }
+
+  std::string valid = readFile(images / "ycc420.jpg");
+
+  // Huffman tables with more codes of a length than fit, inserted ahead of the valid ones.
+  for (unsigned int count : {3u, 255u}) {
+    std::string table = "\xff\xc4";
+    table += static_cast<char>((19 + count) >> 8);
+    table += static_cast<char>((19 + count) & 0xff);
+    table += '\0';
+    table += static_cast<char>(count);
+    table.append(15, '\0');
+    for (unsigned int symbol = 0; symbol < count; ++symbol) {
+      table += static_cast<char>(symbol);
+    }
+    std::string jpeg = valid;
+    jpeg.insert(2, table);
+    check(!dcurses::decodeJpeg(jpeg), "reject over-subscribed Huffman table with " + std::to_string(count) +
+          " 1-bit codes");
+  }
+
+  std::string oversized = valid;
+  std::size_t frame = findSegment(oversized, 0xc0);
+  check(frame != std::string::npos, "find SOF0");
+  if (frame != std::string::npos) {
+    putBigEndian(oversized, frame + 5, 0xffff, 2);
+    putBigEndian(oversized, frame + 7, 0xffff, 2);
+    check(!dcurses::decodeJpeg(oversized), "reject oversized JPEG");
+  }
+}
+
+void testZlib() {
+  std::mt19937 random {2};
+  std::string data;
+  for (unsigned int i = 0; i < 100000; ++i) {
+    data += static_cast<char>(random() % 8 == 0 ? random() : 'a' + i % 7);
+  }
+  std::string compressed = dcurses::zlibCompress(data);
+  check(dcurses::zlibDecompress(compressed) == data, "zlib round trip");
+  check(dcurses::zlibDecompress(compressed, size(data)) == data, "zlib round trip at the size limit");
+  check(!dcurses::zlibDecompress(compressed, size(data) - 1), "zlib output over the size limit");
+  decodeDamaged(compressed.substr(0, 2000), [](std::string_view damaged) { dcurses::zlibDecompress(damaged, 1 << 20); });
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::filesystem::path images = argc > 1 ? argv[1] : "src/tests/images";
+  testZlib();
+  testPng(images);
+  testJpeg(images);
+  if (failures != 0) {
+    std::cerr << failures << " failed\n";
+    return 1;
+  }
+  std::cout << "codec tests passed\n";
+  return 0;
+}
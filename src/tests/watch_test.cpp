@@ -0,0 +1,124 @@
+// Copyright 2022 Daniel Liu
+
+// Tests for noticing files changed by other processes. Edits a file in the project root, which
+// the file tree opens as ./<name>, rewrites it from outside, and checks that the editor reloads
+// it, and that :w refuses to overwrite a rewrite even when no change notification arrives.
+
+#include <poll.h>
+#include <stdlib.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dcurses/Terminal.hpp"
+#include "dcurses/WindowManager.hpp"
+#include "dvim/dvim.hpp"
+#include "dvim/EditorView.hpp"
+#include "dvim/FileWatcher.hpp"
+
+namespace {
+
+unsigned int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::cerr << "FAIL: " << what << "\n";
+    ++failures;
+  }
+}
+
+void writeFile(const std::filesystem::path &path, std::string_view contents) {
+  std::ofstream file {path, std::ios::binary};
+  file << contents;
+}
+
+std::string readFile(const std::filesystem::path &path) {
+  std::ifstream file {path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+/*
+ * Waits up to a second for the watcher to report changes, and returns them.
+ */
+std::vector<std::filesystem::path> waitForChanges(dvim::FileWatcher &watcher) {
+  struct pollfd fd = {watcher.fd(), POLLIN, 0};
+  poll(&fd, 1, 1000);
+  return watcher.readChanges();
+}
+
+/*
+ * Returns the whole screen as the terminal would receive it after a full repaint. The cell under
+ * the cursor is styled separately, so a line's first character is not next to the rest.
+ */
+std::string screen(dcurses::HeadlessTerminal &terminal, dcurses::WindowManager &manager,
+                   dvim::EditorView &view) {
+  manager.updateSize();
+  view.refresh();
+  manager.invalidate();
+  terminal.clearOutput();
+  manager.refresh();
+  return terminal.output();
+}
+
+void typeKeys(dvim::EditorView &view, std::string_view keys) {
+  for (char ch : keys) {
+    view.handleInput(ch);
+  }
+}
+
+}  // namespace
+
+int main() {
+  char directory[] = "/tmp/dvim_watch_testXXXXXX";
+  if (!mkdtemp(directory)) {
+    std::cerr << "cannot create a temporary directory\n";
+    return 1;
+  }
+  std::filesystem::current_path(directory);
+  writeFile("foo.txt", "aaaa\n");
+
+  dcurses::HeadlessTerminal terminal {80, 24};
+  dcurses::HeadlessTerminal controllerTerminal {80, 24};
+  dcurses::WindowManager manager {terminal};
+  dvim::dvimController controller {controllerTerminal};
+  dvim::FileWatcher watcher;
+  {
+    dvim::EditorView view {"./foo.txt", manager, controller, watcher};
+    check(screen(terminal, manager, view).find("aaa") != std::string::npos, "show the file");
+
+    // Without unsaved changes, a rewrite is reloaded.
+    writeFile("foo.txt", "zzzzzzzz\n");
+    auto changes = waitForChanges(watcher);
+    if (watcher.fd() != -1) {
+      view.handleFileChanges(changes);
+      check(screen(terminal, manager, view).find("zzzzzzz") != std::string::npos,
+            "reload a rewritten top-level file");
+    }
+
+    // With unsaved changes, :w refuses to overwrite a rewrite, even if its notification is lost.
+    typeKeys(view, "ix\033");
+    writeFile("foo.txt", "yyyyyyyyyyyy\n");
+    waitForChanges(watcher);
+    typeKeys(view, ":w\r");
+    check(readFile("foo.txt") == "yyyyyyyyyyyy\n", "refuse to overwrite a rewrite");
+    check(screen(terminal, manager, view).find("ERROR") != std::string::npos, "report the conflict");
+
+    // :w! overwrites it anyway.
+    typeKeys(view, "x:w!\r");
+    check(readFile("foo.txt").rfind("x", 0) == 0, "overwrite with :w!");
+  }
+  std::filesystem::current_path("/");
+  std::filesystem::remove_all(directory);
+
+  if (failures != 0) {
+    std::cerr << failures << " failed\n";
+    return 1;
+  }
+  std::cout << "watch tests passed\n";
+  return 0;
+}